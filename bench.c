@@ -0,0 +1,572 @@
+/* Micro-benchmarks for the hot kernels in main.c.
+ *
+ * Builds the game sources in directly (without main()) so every kernel is
+ * timed exactly as the game compiles it. Each benchmark reports the best
+ * ns/op over several timed batches plus a throughput figure; results can be
+ * saved as a baseline and later runs compared against it. Before anything
+ * is timed, the batch step/reset/observe API is checked against the same
+ * games stepped one by one; a mismatch exits 1.
+ *
+ *   ./vaders_bench [--filter TEXT] [--save FILE] [--compare FILE] [--threshold PCT]
+ */
+#define VADERS_NO_MAIN
+#include "main.c"
+
+#define BENCH_BATCHES 7
+#define BENCH_BATCH_NS 20000000.0   /* aim for ~20 ms per timed batch */
+#define BENCH_MAX 64
+
+typedef struct {
+    const char *name;
+    const char *unit;           /* what the throughput column counts */
+    double items_per_op;        /* units processed per op */
+    void (*setup)(void);
+    void (*run)(long iters);
+} Bench;
+
+typedef struct {
+    char name[64];
+    double ns_per_op;
+} BenchResult;
+
+static double bench_now_ns(void) {
+    return (double)SDL_GetPerformanceCounter() * 1e9 / (double)SDL_GetPerformanceFrequency();
+}
+
+/* Grows the iteration count until one batch takes long enough to time, then
+ * keeps the fastest of BENCH_BATCHES batches. */
+static double bench_measure(const Bench *b) {
+    long iters = 1;
+    for (;;) {
+        if (b->setup) b->setup();
+        double t0 = bench_now_ns();
+        b->run(iters);
+        double dt = bench_now_ns() - t0;
+        if (dt >= BENCH_BATCH_NS / 10 || iters >= (1L << 30)) {
+            double scale = BENCH_BATCH_NS / (dt > 1.0 ? dt : 1.0);
+            iters = (long)(iters * scale) + 1;
+            break;
+        }
+        iters *= 10;
+    }
+    double best = 0.0;
+    for (int i = 0; i < BENCH_BATCHES; ++i) {
+        if (b->setup) b->setup();
+        double t0 = bench_now_ns();
+        b->run(iters);
+        double ns = (bench_now_ns() - t0) / (double)iters;
+        if (i == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+/* -------------------- Audio -------------------- */
+
+#define BENCH_AUDIO_SAMPLES 2048
+static Sint16 bench_audio_buf[BENCH_AUDIO_SAMPLES];
+static int bench_voices = 0;
+
+static void bench_audio_setup(void) {
+    static const Waveform waves[3] = {WAVE_SQUARE, WAVE_SINE, WAVE_NOISE};
+    ADSR env = {5, 20, 0, 50, 0.6};
+    memset(sounds, 0, sizeof(ActiveSound) * (size_t)sound_capacity);
+    memset(sample_voices, 0, sizeof(SampleVoice) * (size_t)sample_capacity);
+    /* Long notes so every voice stays in its sustain stage for the batch. */
+    for (int i = 0; i < bench_voices; ++i) {
+        sounds[i] = make_voice(220.0 + 55.0 * i, 600000, waves[i % 3], env);
+    }
+}
+
+static void bench_audio_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        audio_callback(NULL, (Uint8 *)bench_audio_buf, (int)sizeof(bench_audio_buf));
+    }
+}
+
+static void bench_audio_1(void) { bench_voices = 1; bench_audio_setup(); }
+static void bench_audio_8(void) { bench_voices = 8; bench_audio_setup(); }
+static void bench_audio_32(void) { bench_voices = 32; bench_audio_setup(); }
+
+/* -------------------- Collisions -------------------- */
+
+/* check_collisions moves and retires bullets and kills aliens, so every op
+ * restores the same starting state first; the copy is a few KB at most and
+ * is included in the timings. */
+typedef struct {
+    AlienStore formation;
+    SDL_Rect player_bullets[BULLETS_DEFAULT];
+    SDL_Rect alien_bullets[BULLETS_DEFAULT];
+    int player_bullet_count;
+    int alien_bullet_count;
+} CollisionState;
+
+static CollisionState bench_collision_state;
+static int bench_bullets = 0;
+static int bench_aliens = ALIEN_ROWS_DEFAULT * ALIEN_COLS_DEFAULT;
+
+static void bench_collision_setup(void) {
+    Rng rng;
+    rng_seed(&rng, 1234);
+    reset_game(&game);
+    for (int a = 0; a < game.formation.count && alien_alive_count(&game.formation) > bench_aliens; a += 2) {
+        alien_kill(&game.formation, a, game.tick);
+    }
+    for (int a = 0; a < game.formation.count && alien_alive_count(&game.formation) > bench_aliens; ++a) {
+        if (alien_is_alive(&game.formation, a)) alien_kill(&game.formation, a, game.tick);
+    }
+    CollisionState *s = &bench_collision_state;
+    alien_store_copy(&s->formation, &game.formation);
+    s->player_bullet_count = s->alien_bullet_count = bench_bullets;
+    for (int i = 0; i < bench_bullets; ++i) {
+        s->player_bullets[i] = (SDL_Rect){rng_range(&rng, WIDTH), 40 + rng_range(&rng, HEIGHT - 80), 5, 10};
+        s->alien_bullets[i] = (SDL_Rect){rng_range(&rng, WIDTH), rng_range(&rng, HEIGHT - 20), 5, 10};
+    }
+    game.particles.count = 0;
+}
+
+static void bench_collision_run(long iters) {
+    const CollisionState *s = &bench_collision_state;
+    for (long i = 0; i < iters; ++i) {
+        alien_store_copy(&game.formation, &s->formation);
+        game.player_bullet_count = s->player_bullet_count;
+        game.alien_bullet_count = s->alien_bullet_count;
+        memcpy(game.player_bullets, s->player_bullets, sizeof(SDL_Rect) * (size_t)s->player_bullet_count);
+        memcpy(game.alien_bullets, s->alien_bullets, sizeof(SDL_Rect) * (size_t)s->alien_bullet_count);
+        game.score = 0;
+        game.lives = 3;
+        game.invuln_timer = 0;
+        game.active = 1;
+        game.particles.count = 0;
+        game.events.count = 0;
+        check_collisions(&game);
+    }
+}
+
+static void bench_collide_8_full(void) { bench_bullets = 8; bench_aliens = 24; bench_collision_setup(); }
+static void bench_collide_64_full(void) { bench_bullets = 64; bench_aliens = 24; bench_collision_setup(); }
+static void bench_collide_128_full(void) { bench_bullets = 128; bench_aliens = 24; bench_collision_setup(); }
+static void bench_collide_128_sparse(void) { bench_bullets = 128; bench_aliens = 4; bench_collision_setup(); }
+
+/* -------------------- Drawing -------------------- */
+
+static SDL_Surface *bench_surface = NULL;
+static SDL_Renderer *bench_renderer = NULL;
+
+static int bench_draw_init(void) {
+    bench_surface = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!bench_surface) {
+        SDL_Log("Failed to create bench surface: %s", SDL_GetError());
+        return 0;
+    }
+    bench_renderer = SDL_CreateSoftwareRenderer(bench_surface);
+    if (!bench_renderer) {
+        SDL_Log("Failed to create software renderer: %s", SDL_GetError());
+        SDL_FreeSurface(bench_surface);
+        bench_surface = NULL;
+        return 0;
+    }
+    SDL_SetRenderDrawBlendMode(bench_renderer, SDL_BLENDMODE_BLEND);
+    build_sprite_atlas(bench_renderer);
+    build_glyph_atlas(bench_renderer);
+    softfb_init(bench_renderer, WIDTH, HEIGHT);
+    softfb.enabled = 0;
+    return 1;
+}
+
+static void bench_draw_free(void) {
+    destroy_glyph_atlas();
+    destroy_sprite_atlas();
+    softfb_free();
+    if (bench_renderer) SDL_DestroyRenderer(bench_renderer);
+    if (bench_surface) SDL_FreeSurface(bench_surface);
+}
+
+static void bench_draw_setup(void) {
+    softfb.enabled = 0;
+    render_set_color(bench_renderer, COLOR_ALIEN.r, COLOR_ALIEN.g, COLOR_ALIEN.b, 255);
+}
+
+/* The same kernels drawing into the software framebuffer. */
+static void bench_soft_setup(void) {
+    softfb.enabled = softfb.pixels != NULL;
+    render_set_color(bench_renderer, COLOR_ALIEN.r, COLOR_ALIEN.g, COLOR_ALIEN.b, 255);
+}
+
+static void bench_draw_bitmap_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        draw_bitmap(bench_renderer, (int)(i & 511), 200, 3, alien_bitmaps[i % ALIEN_TYPES][i & 1],
+                    ALIEN_BMP_W, ALIEN_BMP_H);
+    }
+    draw_list_flush(bench_renderer);   /* queued spans count toward the run */
+}
+
+static void bench_draw_sprite_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        draw_sprite(bench_renderer, SPRITE_ALIEN(i % ALIEN_TYPES, i & 1), (int)(i & 511), 200, 3, COLOR_ALIEN);
+    }
+}
+
+static void bench_draw_text_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        draw_text_block(bench_renderer, 10, 10, 2, "SCORE: 1234567");
+    }
+}
+
+/* -------------------- Particles -------------------- */
+
+static void bench_particles_setup(void) {
+    rng_seed(&game.fx_rng, 99);
+    game.particles.count = 0;
+}
+
+/* Steady state of an explosion-heavy frame: a burst every tick into a pool
+ * that stays near capacity. */
+static void bench_particles_spawn_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        spawn_particles(&game.particles, &game.fx_rng, 400, 300);
+        update_particles(&game.particles, SIM_DT_MS);
+    }
+}
+
+/* Integration alone over a full pool whose particles never expire. */
+static void bench_particles_full_setup(void) {
+    bench_particles_setup();
+    while (game.particles.count < game.particles.capacity) spawn_particles(&game.particles, &game.fx_rng, 400, 300);
+    for (int i = 0; i < game.particles.count; ++i) game.particles.life[i] = 1e30f;
+}
+
+static void bench_particles_update_run(long iters) {
+    for (long i = 0; i < iters; ++i) update_particles(&game.particles, SIM_DT_MS);
+}
+
+/* -------------------- Observations -------------------- */
+
+static ObsSpec bench_obs_spec;
+static Uint8 bench_obs_frame[160 * 120 * OBS_CHANNELS];
+
+/* A mid-wave state with some aliens down and bullets in flight. */
+static void bench_obs_setup(void) {
+    game_reset(&game, 42);
+    for (int i = 0; i < 600; ++i) {
+        Input in;
+        autopilot_input(&game, &in);
+        game_step(&game, input_pack(&in));
+    }
+}
+
+static void bench_obs_84_planes(void) { bench_obs_spec = (ObsSpec){84, 84, OBS_PLANES}; bench_obs_setup(); }
+static void bench_obs_160_gray(void) { bench_obs_spec = (ObsSpec){160, 120, OBS_GRAY}; bench_obs_setup(); }
+
+static void bench_obs_run(long iters) {
+    for (long i = 0; i < iters; ++i) game_rasterize(&game, &bench_obs_spec, bench_obs_frame);
+}
+
+/* -------------------- Rewind -------------------- */
+
+#define BENCH_REWIND_SECONDS 10
+
+static Rewind bench_rewind;
+static Uint64 bench_rewind_state[8 * 1024];   /* aligned for the Game at its start */
+
+/* Ten seconds of autopilot play from the observation start state. */
+static void bench_rewind_setup(void) {
+    bench_obs_setup();
+    for (int i = 0; i < BENCH_REWIND_SECONDS * SIM_HZ; ++i) {
+        Input in;
+        autopilot_input(&game, &in);
+        rewind_push(&bench_rewind, &game, input_pack(&in));
+        sim_tick(&game, &in);
+    }
+    game_state_save(&game, (Uint8 *)bench_rewind_state);
+}
+
+/* Coding the newest state against its keyframe, as every tick does. */
+static void bench_rewind_encode_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        rewind_encode((const Uint8 *)bench_rewind_state, bench_rewind.key_state, bench_rewind.state_size, bench_rewind.encoded);
+    }
+}
+
+/* Seeking to held ticks spread over the history. */
+static void bench_rewind_restore_run(long iters) {
+    for (long i = 0; i < iters; ++i) {
+        Uint32 tick = bench_rewind.first + (Uint32)((i * 97) % bench_rewind.count);
+        rewind_restore(&bench_rewind, &game, tick);
+    }
+}
+
+/* -------------------- Batch -------------------- */
+
+#define BENCH_BATCH_GAMES 16
+#define BENCH_BATCH_THREADS 2
+#define BENCH_BATCH_CHECK_STEPS 20000
+#define BENCH_BATCH_ACTIONS (INPUT_LEFT | INPUT_RIGHT | INPUT_FIRE)
+
+static Batch bench_batch;
+static const ObsSpec bench_batch_spec = {84, 84, OBS_PLANES};
+static Uint8 *bench_batch_frames = NULL;
+static Uint8 bench_batch_actions[BENCH_BATCH_GAMES];
+static int bench_batch_rewards[BENCH_BATCH_GAMES];
+static Uint8 bench_batch_dones[BENCH_BATCH_GAMES];
+static Observation bench_batch_obs[BENCH_BATCH_GAMES];
+static Rng bench_batch_rng;
+
+static int bench_batch_init(Batch *b, const Limits *l) {
+    if (!batch_init(b, BENCH_BATCH_GAMES, BENCH_BATCH_THREADS, l, 1)) return 0;
+    batch_set_observations(b, &bench_batch_spec, bench_batch_frames, NULL);
+    return 1;
+}
+
+static void bench_batch_random_actions(void) {
+    for (int i = 0; i < BENCH_BATCH_GAMES; ++i) {
+        bench_batch_actions[i] = (Uint8)(rng_next(&bench_batch_rng) & BENCH_BATCH_ACTIONS);
+    }
+}
+
+/* Steps a fresh batch under random actions next to the same games stepped
+ * one by one, and requires identical rewards, dones, observations and
+ * frames, including across batch_reset. Also fails if no game ever scored
+ * or ended, as the comparison would then prove little. */
+static int bench_batch_check(const Limits *l) {
+    Batch b = {0};
+    Arena arena = {0};
+    Game ref[BENCH_BATCH_GAMES];
+    Uint8 *frame = malloc(obs_frame_size(&bench_batch_spec));
+    int ok = frame && bench_batch_init(&b, l) && arena_init(&arena, game_footprint(l) * BENCH_BATCH_GAMES);
+    for (int i = 0; ok && i < BENCH_BATCH_GAMES; ++i) {
+        ok = game_init(&ref[i], &arena, l);
+        if (ok) game_reset(&ref[i], batch_episode_seed(&b, i));
+    }
+    if (!ok) {
+        SDL_Log("Failed to set up the batch check");
+        batch_free(&b);
+        arena_free(&arena);
+        free(frame);
+        return 0;
+    }
+    rng_seed(&bench_batch_rng, 7);
+    long reward = 0, episodes = 0;
+    const char *failed = NULL;
+    int step = 0;
+    for (; step < BENCH_BATCH_CHECK_STEPS && !failed; ++step) {
+        bench_batch_random_actions();
+        batch_step(&b, bench_batch_actions, bench_batch_rewards, bench_batch_dones);
+        for (int i = 0; i < BENCH_BATCH_GAMES && !failed; ++i) {
+            int want_reward = 0, want_done = 1;
+            if (ref[i].active) {
+                want_reward = game_step(&ref[i], bench_batch_actions[i]);
+                want_done = !ref[i].active;
+            }
+            if (bench_batch_rewards[i] != want_reward) failed = "reward";
+            if (bench_batch_dones[i] != want_done) failed = "done";
+            reward += bench_batch_rewards[i];
+            /* Frames are costly to compare, so only now and then. */
+            if (step % 64 == 0 || bench_batch_dones[i]) {
+                game_rasterize(&ref[i], &bench_batch_spec, frame);
+                size_t at = obs_frame_stride(&bench_batch_spec) * (size_t)i;
+                if (memcmp(frame, bench_batch_frames + at, obs_frame_size(&bench_batch_spec)) != 0) failed = "frame";
+            }
+            if (bench_batch_dones[i]) {
+                batch_reset(&b, i);
+                game_reset(&ref[i], batch_episode_seed(&b, i));
+                episodes++;
+            }
+        }
+        memset(bench_batch_obs, 0, sizeof(bench_batch_obs));
+        batch_observe(&b, bench_batch_obs);
+        for (int i = 0; i < BENCH_BATCH_GAMES && !failed; ++i) {
+            Observation want;
+            memset(&want, 0, sizeof(want));
+            game_observe(&ref[i], &want);
+            if (memcmp(&want, &bench_batch_obs[i], sizeof(want)) != 0) failed = "observation";
+        }
+    }
+    if (!failed && (reward == 0 || episodes == 0)) failed = "coverage";
+    printf("check batch/step: %d steps x %d games, reward %ld, %ld episodes: %s%s\n", step,
+           BENCH_BATCH_GAMES, reward, episodes, failed ? "MISMATCH in " : "ok", failed ? failed : "");
+    batch_free(&b);
+    arena_free(&arena);
+    free(frame);
+    return !failed;
+}
+
+/* One tick of every game under random actions, restarting those that end. */
+static void bench_batch_step_run(long iters) {
+    for (long n = 0; n < iters; ++n) {
+        bench_batch_random_actions();
+        batch_step(&bench_batch, bench_batch_actions, bench_batch_rewards, bench_batch_dones);
+        for (int i = 0; i < BENCH_BATCH_GAMES; ++i) {
+            if (bench_batch_dones[i]) batch_reset(&bench_batch, i);
+        }
+    }
+}
+
+/* -------------------- Baselines -------------------- */
+
+static int load_baseline(const char *path, BenchResult *out, int max) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        SDL_Log("Failed to open baseline %s", path);
+        return -1;
+    }
+    int n = 0;
+    while (n < max && fscanf(fp, "%63s %lf", out[n].name, &out[n].ns_per_op) == 2) n++;
+    fclose(fp);
+    return n;
+}
+
+static int save_baseline(const char *path, const BenchResult *results, int n) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        SDL_Log("Failed to write baseline %s", path);
+        return 0;
+    }
+    for (int i = 0; i < n; ++i) fprintf(fp, "%s %.3f\n", results[i].name, results[i].ns_per_op);
+    fclose(fp);
+    return 1;
+}
+
+static const BenchResult *find_result(const BenchResult *results, int n, const char *name) {
+    for (int i = 0; i < n; ++i) {
+        if (strcmp(results[i].name, name) == 0) return &results[i];
+    }
+    return NULL;
+}
+
+/* -------------------- Main -------------------- */
+
+static void print_bench_usage(const char *prog) {
+    printf("usage: %s [--filter TEXT] [--save FILE] [--compare FILE] [--threshold PCT]\n"
+           "  --filter T     only run benchmarks whose name contains T\n"
+           "  --save F       write the results as a baseline\n"
+           "  --compare F    compare against a saved baseline; exit 1 on a regression\n"
+           "  --threshold P  slowdown in percent that counts as a regression (default 10)\n",
+           prog);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL, *save = NULL, *compare = NULL;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(arg, "--filter") == 0 && has_value) {
+            filter = argv[++i];
+        } else if (strcmp(arg, "--save") == 0 && has_value) {
+            save = argv[++i];
+        } else if (strcmp(arg, "--compare") == 0 && has_value) {
+            compare = argv[++i];
+        } else if (strcmp(arg, "--threshold") == 0 && has_value) {
+            threshold = atof(argv[++i]);
+        } else {
+            print_bench_usage(argv[0]);
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_VIDEO) != 0) {
+        SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
+        return 1;
+    }
+    audio.freq = 44100;
+    init_wavetables();
+    const Limits limits = LIMITS_DEFAULT;
+    Arena arena;
+    if (!arena_init(&arena, game_footprint(&limits) + audio_pools_footprint(&limits) +
+                                alien_store_footprint(limits.alien_rows, limits.alien_cols) +
+                                rewind_footprint(&limits, BENCH_REWIND_SECONDS)) ||
+        !game_init(&game, &arena, &limits) || !audio_pools_init(&arena, &limits) ||
+        !rewind_init(&bench_rewind, &arena, &limits, BENCH_REWIND_SECONDS) ||
+        game_state_size(&limits) > sizeof(bench_rewind_state) ||
+        !alien_store_init(&bench_collision_state.formation, &arena, limits.alien_rows, limits.alien_cols) ||
+        !bench_draw_init()) {
+        arena_free(&arena);
+        SDL_Quit();
+        return 1;
+    }
+    bench_batch_frames = malloc(obs_frame_stride(&bench_batch_spec) * BENCH_BATCH_GAMES);
+    if (!bench_batch_frames || !bench_batch_check(&limits) || !bench_batch_init(&bench_batch, &limits)) {
+        free(bench_batch_frames);
+        bench_draw_free();
+        arena_free(&arena);
+        SDL_Quit();
+        return 1;
+    }
+
+    const Bench benches[] = {
+        {"audio/voices=1", "samples", BENCH_AUDIO_SAMPLES, bench_audio_1, bench_audio_run},
+        {"audio/voices=8", "samples", BENCH_AUDIO_SAMPLES, bench_audio_8, bench_audio_run},
+        {"audio/voices=32", "samples", BENCH_AUDIO_SAMPLES, bench_audio_32, bench_audio_run},
+        {"batch/step", "steps", BENCH_BATCH_GAMES, NULL, bench_batch_step_run},
+        {"collide/bullets=8,aliens=24", "bullets", 16, bench_collide_8_full, bench_collision_run},
+        {"collide/bullets=64,aliens=24", "bullets", 128, bench_collide_64_full, bench_collision_run},
+        {"collide/bullets=128,aliens=24", "bullets", 256, bench_collide_128_full, bench_collision_run},
+        {"collide/bullets=128,aliens=4", "bullets", 256, bench_collide_128_sparse, bench_collision_run},
+        {"draw/bitmap", "sprites", 1, bench_draw_setup, bench_draw_bitmap_run},
+        {"draw/sprite", "sprites", 1, bench_draw_setup, bench_draw_sprite_run},
+        {"draw/text", "glyphs", 14, bench_draw_setup, bench_draw_text_run},
+        {"draw/bitmap-soft", "sprites", 1, bench_soft_setup, bench_draw_bitmap_run},
+        {"draw/sprite-soft", "sprites", 1, bench_soft_setup, bench_draw_sprite_run},
+        {"draw/text-soft", "glyphs", 14, bench_soft_setup, bench_draw_text_run},
+        {"particles/spawn+update", "ticks", 1, bench_particles_setup, bench_particles_spawn_run},
+        {"particles/update", "particles", PARTICLE_MAX, bench_particles_full_setup, bench_particles_update_run},
+        {"obs/84x84-planes", "frames", 1, bench_obs_84_planes, bench_obs_run},
+        {"obs/160x120-gray", "frames", 1, bench_obs_160_gray, bench_obs_run},
+        {"rewind/encode", "ticks", 1, bench_rewind_setup, bench_rewind_encode_run},
+        {"rewind/restore", "ticks", 1, bench_rewind_setup, bench_rewind_restore_run},
+    };
+    int bench_count = (int)(sizeof(benches) / sizeof(benches[0]));
+
+    BenchResult base[BENCH_MAX];
+    int base_count = 0;
+    if (compare) {
+        base_count = load_baseline(compare, base, BENCH_MAX);
+        if (base_count < 0) {
+            batch_free(&bench_batch);
+            free(bench_batch_frames);
+            bench_draw_free();
+            arena_free(&arena);
+            SDL_Quit();
+            return 1;
+        }
+    }
+
+    BenchResult results[BENCH_MAX];
+    int result_count = 0;
+    int regressions = 0;
+    printf("%-32s %12s %16s", "benchmark", "ns/op", "throughput");
+    printf(compare ? " %10s\n" : "\n", "vs base");
+    for (int i = 0; i < bench_count; ++i) {
+        const Bench *b = &benches[i];
+        if (filter && !strstr(b->name, filter)) continue;
+        double ns = bench_measure(b);
+        BenchResult *r = &results[result_count++];
+        snprintf(r->name, sizeof(r->name), "%s", b->name);
+        r->ns_per_op = ns;
+
+        double per_sec = b->items_per_op * 1e9 / ns;
+        printf("%-32s %12.1f %10.2fM %-5s", b->name, ns, per_sec / 1e6, b->unit);
+        const BenchResult *old = compare ? find_result(base, base_count, b->name) : NULL;
+        if (old) {
+            double delta = (ns - old->ns_per_op) / old->ns_per_op * 100.0;
+            int regressed = delta > threshold;
+            regressions += regressed;
+            printf(" %+9.1f%%%s", delta, regressed ? "  REGRESSION" : "");
+        } else if (compare) {
+            printf(" %10s", "new");
+        }
+        printf("\n");
+    }
+
+    if (save) save_baseline(save, results, result_count);
+    if (compare) {
+        printf("%d regression%s over %.0f%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+    }
+
+    batch_free(&bench_batch);
+    free(bench_batch_frames);
+    bench_draw_free();
+    arena_free(&arena);
+    SDL_Quit();
+    return regressions ? 1 : 0;
+}
@@ -1,3 +1,5 @@
+/* shm_open, mmap and friends are hidden by -std=c11 on glibc. */
+#define _DEFAULT_SOURCE
 #include <SDL2/SDL.h>
 #include <math.h>
 #include <stdint.h>
@@ -5,6 +7,18 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#if defined(__unix__) || defined(__APPLE__)
+#define VADERS_HAVE_SHM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -14,22 +28,41 @@
 #define HEIGHT 600
 #define SHIP_WIDTH 60
 #define SHIP_HEIGHT 20
-#define SHIP_SPEED 5
+#define SHIP_SPEED 2.5f        /* px per tick */
+
+/* The simulation advances in fixed ticks; rendering interpolates between the
+ * last two ticks. 125 Hz is exactly twice the old 16 ms frame loop, so all
+ * per-tick speeds are half the old per-frame ones and timers in ms stay
+ * integral. */
+#define SIM_HZ 125
+#define SIM_DT_MS (1000 / SIM_HZ)
+#define MAX_FRAME_MS 250
 
 #define BULLET_WIDTH 4
 #define BULLET_HEIGHT 10
-#define BULLET_SPEED 10
-#define MAX_BULLETS 128
+#define BULLET_SPEED 5          /* px per tick */
+#define BULLETS_DEFAULT 128     /* per side, see --bullets */
 
-#define ALIEN_ROWS 3
-#define ALIEN_COLS 8
+#define ALIEN_ROWS_DEFAULT 3    /* see --formation */
+#define ALIEN_COLS_DEFAULT 8
+#define ALIEN_TYPES 3           /* rows cycle through the alien bitmaps */
 #define ALIEN_WIDTH 40
 #define ALIEN_HEIGHT 20
 #define ALIEN_H_SPACING 20
 #define ALIEN_V_SPACING 20
-#define ALIEN_SPEED 2
+#define ALIEN_SPEED 1.0f        /* px per tick, wave 1 */
+#define ALIEN_MAX_SPEED 4.0f
 #define ALIEN_STEP_DOWN 20
-#define ALIEN_COUNT (ALIEN_ROWS * ALIEN_COLS)
+#define ALIEN_PITCH_X (ALIEN_WIDTH + ALIEN_H_SPACING)
+#define ALIEN_PITCH_Y (ALIEN_HEIGHT + ALIEN_V_SPACING)
+/* The largest formation that fits across the screen and leaves room to
+ * descend before reaching the ship. */
+#define ALIEN_MAX_COLS ((WIDTH + ALIEN_H_SPACING) / ALIEN_PITCH_X)
+#define ALIEN_MAX_ROWS 10
+#define ALIEN_MAX_COUNT (ALIEN_MAX_ROWS * ALIEN_MAX_COLS)
+#define ALIEN_WORDS(n) (((n) + 63) / 64)
+#define FORMATION_X0 100
+#define FORMATION_Y0 50
 
 #define ALIEN_BMP_W 10
 #define ALIEN_BMP_H 5
@@ -40,70 +73,168 @@
 static const SDL_Color COLOR_PLAYER        = {0, 255, 255, 255};
 static const SDL_Color COLOR_PLAYER_BULLET = {255, 255, 255, 255};
 static const SDL_Color COLOR_ALIEN         = {0, 255, 0, 255};
+static const SDL_Color COLOR_ALIEN_FLASH   = {255, 255, 255, 255};
 static const SDL_Color COLOR_ALIEN_BULLET  = {255, 255, 0, 255};
 static const SDL_Color COLOR_HUD           = {255, 255, 255, 255};
 
 #define SHAKE_DURATION 10
 #define SHAKE_MAG 3
-#define PARTICLE_MAX 256
-#define PARTICLE_LIFETIME 300
-
-/* Game state */
-static SDL_Rect ship;
-static SDL_Rect player_bullets[MAX_BULLETS];
-static SDL_Rect alien_bullets[MAX_BULLETS];
-static int player_bullet_count = 0;
-static int alien_bullet_count = 0;
-static SDL_Rect aliens[ALIEN_COUNT];
-static float alien_fx[ALIEN_COUNT];
-static int alien_alive[ALIEN_COUNT];
-static int alien_direction = 1;
-static int score = 0;
-static int lives = 3;
-static int wave = 1;
-static float alien_base_speed = ALIEN_SPEED;
-static int alien_fire_interval = 1500;
-static int alien_fire_timer = 1500;
-static int invuln_timer = 0;
-static int wave_clear_timer = -1;
-static int active = 1;
-static int alien_flash[ALIEN_COUNT];
-static int shake_timer = 0;
-static int shake_x = 0, shake_y = 0;
-
-typedef struct {
-    float x, y;
-    float vx, vy;
-    int life;
-    int active;
-} Particle;
+#define PARTICLE_MAX 256            /* default pool size, see --particles */
+#define VOICES_DEFAULT 32           /* clip and synth voices each, see --voices */
+#define PENDING_SOUNDS_DEFAULT 64   /* delayed beeps, see --pending-sounds */
+
+/* Pool sizes. They are fixed for a run, set from the command line or a
+ * config file, and every pool is carved out of one Arena up front, so
+ * nothing is allocated once the game is running. */
+typedef struct {
+    int alien_rows, alien_cols;
+    int bullets;            /* per side */
+    int particles;
+    int voices;
+    int pending_sounds;
+} Limits;
+
+#define LIMITS_DEFAULT {ALIEN_ROWS_DEFAULT, ALIEN_COLS_DEFAULT, BULLETS_DEFAULT, PARTICLE_MAX, \
+                        VOICES_DEFAULT, PENDING_SOUNDS_DEFAULT}
+
+/* Bump allocator over a single zeroed block; everything in it lives until
+ * the arena is freed. */
+typedef struct {
+    void *block;
+    Uint8 *base;            /* block rounded up to ARENA_ALIGN */
+    size_t size;
+    size_t used;
+} Arena;
+
+/* Alien formation as structure-of-arrays. Live aliens never move relative to
+ * each other, so each column and row keeps a fixed offset from the formation
+ * origin and moving the whole formation is a single origin update. Liveness is a packed
+ * bitmask; per-row/column counts, the bottom-most live alien of each column
+ * and the outermost live columns are maintained incrementally on kills. The
+ * arrays are sized for rows x cols and live in an arena. */
+#define ALIEN_FLASH_TICKS ((50 + SIM_DT_MS - 1) / SIM_DT_MS)
+
+typedef struct {
+    int rows, cols, count;
+    float origin_x, prev_origin_x;
+    int origin_y;
+    int direction;
+    uint64_t *alive;                   /* ALIEN_WORDS(count) */
+    float *col_x;                      /* offset of each column from the origin */
+    float *row_y;                      /* offset of each row from the origin */
+    Uint32 *flash_until;               /* game_tick the hit flash ends on */
+    int *row_alive;
+    int *col_alive;
+    int *col_bottom;                   /* index, -1 when the column is empty */
+    int *live_cols;                    /* unordered list of non-empty columns */
+    int live_col_count;
+    int left_col, right_col;
+} AlienStore;
 
-static Particle particles[PARTICLE_MAX];
-static int muzzle_timer = 0;
+/* Dense SoA particle pool: live particles occupy [0, count), spawning
+ * appends and dying swaps the last one in, so there are no idle slots to
+ * walk and the update loops are straight float streams. */
+typedef struct {
+    float *x, *y;
+    float *vx, *vy;
+    float *life;       /* ms remaining */
+    int count;
+    int capacity;
+    int dropped;       /* spawns refused with the pool full */
+} ParticlePool;
+
+/* Everything render_frame reads, copied out of the simulation after a tick
+ * so drawing never touches live game state. */
+typedef struct {
+    Uint32 tick;
+    Uint64 tick_time;       /* perf counter time the tick fell due */
+    float ship_fx, ship_prev_fx;
+    int ship_y;
+    int invuln_timer, muzzle_timer;
+    int shake_x, shake_y;
+    int score, lives, wave, active;
+    AlienStore formation;
+    SDL_Rect *player_bullets;
+    SDL_Rect *alien_bullets;
+    int player_bullet_count, alien_bullet_count;
+    ParticlePool particles;
+} Snapshot;
 
 /* Audio */
 typedef enum { WAVE_SINE, WAVE_SQUARE, WAVE_NOISE } Waveform;
 
 typedef struct {
-    double attack;   /* seconds */
-    double decay;    /* seconds */
-    double sustain;  /* seconds */
-    double release;  /* seconds */
+    double attack;   /* ms */
+    double decay;    /* ms */
+    double sustain;  /* ms, derived from the note duration */
+    double release;  /* ms */
     double sustain_level;
 } ADSR;
 
+typedef enum { ENV_ATTACK, ENV_DECAY, ENV_SUSTAIN, ENV_RELEASE, ENV_DONE } EnvStage;
+
+/* One oscillator voice. Phase is a 32-bit accumulator (2^32 = one cycle) and
+ * the envelope is a piecewise-linear ramp tracked in samples, so the mixer
+ * only steps an amplitude per sample instead of re-evaluating the ADSR. */
 typedef struct {
     int active;
-    double freq;
-    double phase;
-    double t;
-    double total;
     Waveform wave;
-    ADSR env;
+    Uint32 phase;
+    Uint32 phase_inc;
+    Uint32 noise;            /* xorshift32 state */
+    EnvStage stage;
+    int stage_left;          /* samples left in the current stage */
+    int stage_len[ENV_DONE];
+    float amp;
+    float sustain_level;
+    int start;               /* samples of silence before the voice begins */
+    int priority;            /* see sound_priority */
 } ActiveSound;
 
-#define MAX_ACTIVE_SOUNDS 32
-static ActiveSound sounds[MAX_ACTIVE_SOUNDS];
+static ActiveSound *sounds = NULL;
+static int sound_capacity = 0;
+
+/* Playback of a pre-rendered clip from the sound bank: the mixer only reads
+ * and scales. Every game sound plays this way unless its clip failed to
+ * render, so this pool is the one --voices limits in play. */
+typedef struct {
+    const float *data;       /* NULL = free */
+    int len;
+    int pos;
+    float gain;
+    int start;               /* samples of silence before the clip begins */
+    int priority;
+} SampleVoice;
+
+static SampleVoice *sample_voices = NULL;
+static int sample_capacity = 0;
+
+typedef enum { CMD_SYNTH, CMD_SAMPLE } SoundCmdType;
+
+typedef struct {
+    SoundCmdType type;
+    Uint64 when;              /* perf counter time the sound should start */
+    union {
+        ActiveSound synth;
+        SampleVoice sample;
+    };
+} SoundCmd;
+
+/* Single-producer/single-consumer ring of voice-start commands. The game
+ * thread only writes head, the audio callback only writes tail, so neither
+ * side ever takes the audio device lock. */
+#define SOUND_QUEUE_SIZE 64  /* power of two */
+
+typedef struct {
+    SoundCmd cmds[SOUND_QUEUE_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t dropped;     /* pushes rejected because the ring was full */
+    SDL_atomic_t no_voice;    /* commands discarded with every voice busy on louder cues */
+    SDL_atomic_t stolen;      /* voices cut short to make room for a new one */
+} SoundQueue;
+
+static SoundQueue sound_queue;
 
 typedef struct {
     double freq;
@@ -113,13 +244,42 @@ typedef struct {
     int delay_ms;
 } PendingSound;
 
-#define MAX_PENDING_SOUNDS 64
-static PendingSound pending_sounds[MAX_PENDING_SOUNDS];
+/* A delayed beep waiting for its start time. */
+typedef struct {
+    PendingSound beep;
+    Uint64 when;              /* perf counter time it falls due */
+    int priority;
+} ScheduledBeep;
+
+static ScheduledBeep *pending_sounds = NULL;
+static int pending_capacity = 0;
 static int pending_count = 0;
+static int pending_dropped = 0;   /* beeps refused with the list full */
+static int sounds_coalesced = 0;  /* identical sounds merged into one within a tick */
+
+#define AUDIO_BUFFER_DEFAULT 2048
+#define AUDIO_BUFFER_MIN 128
+#define AUDIO_BUFFER_MAX 8192
 
+/* The callback keeps a stream clock: the buffer being mixed covers the
+ * timestamps [stream_start, stream_start + one buffer), so a sound starts
+ * at the exact sample its timestamp maps to, one buffer after it was
+ * stamped. Fields below voices are owned by the audio thread; read them
+ * with the device locked. */
 typedef struct {
     SDL_AudioDeviceID device;
     int freq;
+    int buffer;             /* sample frames per callback */
+    SDL_atomic_t voices;    /* voices mixed in the last callback, for the profiler */
+    Uint64 stream_start;    /* timestamp of the first sample being mixed */
+    Uint64 stream_next;     /* where the next buffer continues the clock */
+    Uint64 last_callback;
+    Uint64 callbacks;
+    int underruns;          /* callbacks over two buffers apart: the device ran dry */
+    int late;               /* sounds whose timestamp had already been mixed past */
+    double latency_sum;     /* timestamp to playout, ms */
+    double latency_max;
+    int latency_count;
 } AudioData;
 
 static AudioData audio = {0};
@@ -129,9 +289,581 @@ typedef enum {
     SND_ALIEN_HIT,
     SND_ALIEN_SHOT,
     SND_WAVE_CLEAR,
-    SND_PLAYER_HIT
+    SND_PLAYER_HIT,
+    SND_COUNT
 } SoundEvent;
 
+/* With every voice busy, a new sound takes over the lowest-priority voice at
+ * or below its own, the quietest of those first; cues the player must hear
+ * outrank the constant fire. */
+static const int sound_priority[SND_COUNT] = {
+    [SND_ALIEN_SHOT] = 0,
+    [SND_PLAYER_SHOT] = 1,
+    [SND_ALIEN_HIT] = 2,
+    [SND_WAVE_CLEAR] = 3,
+    [SND_PLAYER_HIT] = 3,
+};
+
+/* Gain for n identical sounds coalesced into one voice in a tick. */
+#define SOUND_COALESCE_STEP 0.25f
+#define SOUND_COALESCE_MAX_GAIN 1.75f
+
+/* The beeps that make up each event, expressed as delayed beeps. */
+static const struct {
+    SoundEvent event;
+    PendingSound layer;
+} sfx_defs[] = {
+    {SND_PLAYER_SHOT, {880.0, 120, WAVE_SINE,   {10, 40, 0, 40, 0.6},   0}},
+    {SND_ALIEN_HIT,   {220.0, 300, WAVE_SQUARE, {10, 150, 0, 150, 0.5}, 0}},
+    {SND_ALIEN_HIT,   {0.0,   120, WAVE_NOISE,  {5, 60, 0, 60, 0.5},    0}},
+    {SND_ALIEN_SHOT,  {660.0, 80,  WAVE_SINE,   {5, 30, 0, 30, 0.6},    0}},
+    {SND_PLAYER_HIT,  {180.0, 250, WAVE_SINE,   {10, 100, 0, 100, 0.6}, 0}},
+    {SND_WAVE_CLEAR,  {440.0, 120, WAVE_SINE,   {5, 50, 0, 50, 0.6},    0}},
+    {SND_WAVE_CLEAR,  {660.0, 120, WAVE_SINE,   {5, 50, 0, 50, 0.6},    150}},
+    {SND_WAVE_CLEAR,  {880.0, 120, WAVE_SINE,   {5, 50, 0, 50, 0.6},    300}},
+};
+
+/* Every event pre-mixed at the device rate into one mono float clip. */
+typedef struct {
+    float *data;
+    int len;
+} SoundClip;
+
+static SoundClip sound_bank[SND_COUNT];
+
+/* -------------------- Arena -------------------- */
+
+#define ARENA_ALIGN 64
+
+/* Space an allocation of n bytes takes up in an arena. Pool owners sum these
+ * to size the arena before carving their pools out of it. */
+static inline size_t arena_round(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+int arena_init(Arena *a, size_t size) {
+    memset(a, 0, sizeof(*a));
+    a->block = calloc(1, size + ARENA_ALIGN);
+    if (!a->block) {
+        SDL_Log("Failed to allocate a %zu byte arena", size);
+        return 0;
+    }
+    a->base = (Uint8 *)(((uintptr_t)a->block + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+    a->size = size;
+    return 1;
+}
+
+void arena_free(Arena *a) {
+    free(a->block);
+    memset(a, 0, sizeof(*a));
+}
+
+/* Zeroed, cache-line aligned, never freed on its own. NULL only if the
+ * owner sized the arena wrong. */
+void *arena_alloc(Arena *a, size_t n) {
+    size_t need = arena_round(n);
+    if (need > a->size - a->used) {
+        SDL_Log("Arena exhausted: %zu of %zu bytes used, %zu more requested", a->used, a->size, need);
+        return NULL;
+    }
+    void *p = a->base + a->used;
+    a->used += need;
+    return p;
+}
+
+/* Whole-string decimal numbers only: "12x", "" and out-of-range values are
+ * rejected rather than read as whatever prefix parses. Shared by the config
+ * file and the command line. */
+static int parse_long(const char *text, long *out) {
+    char *end;
+    errno = 0;
+    long v = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE) return 0;
+    *out = v;
+    return 1;
+}
+
+static int parse_int(const char *text, int *out) {
+    long v;
+    if (!parse_long(text, &v) || v < INT_MIN || v > INT_MAX) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+static const struct {
+    const char *key;
+    size_t offset;
+    int lo, hi;
+} limit_keys[] = {
+    {"alien_rows", offsetof(Limits, alien_rows), 1, ALIEN_MAX_ROWS},
+    {"alien_cols", offsetof(Limits, alien_cols), 1, ALIEN_MAX_COLS},
+    {"bullets", offsetof(Limits, bullets), 1, 1 << 16},
+    {"particles", offsetof(Limits, particles), 1, 1 << 20},
+    {"voices", offsetof(Limits, voices), 1, 1024},
+    {"pending_sounds", offsetof(Limits, pending_sounds), 1, 1 << 12},
+};
+
+static int limit_key_index(const char *key) {
+    for (int i = 0; i < (int)(sizeof(limit_keys) / sizeof(limit_keys[0])); ++i) {
+        if (strcmp(key, limit_keys[i].key) == 0) return i;
+    }
+    return -1;
+}
+
+/* Returns 0 for an unknown key. */
+int limits_set(Limits *l, const char *key, int value) {
+    int i = limit_key_index(key);
+    if (i < 0) return 0;
+    *(int *)((char *)l + limit_keys[i].offset) = value;
+    return 1;
+}
+
+/* Reads "key = value" lines using the limit_keys names; blank lines and
+ * anything after a # are ignored. */
+int limits_load(Limits *l, const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        SDL_Log("Failed to open config %s", path);
+        return 0;
+    }
+    char line[256];
+    int line_no = 0, ok = 1;
+    while (fgets(line, sizeof(line), fp)) {
+        char key[64], text[64], tail[2];
+        int value;
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        if (sscanf(line, " %63[a-z_] = %63s %1s", key, text, tail) == 2) {
+            int i = limit_key_index(key);
+            if (i < 0) {
+                SDL_Log("%s:%d: unknown setting %s", path, line_no, key);
+                ok = 0;
+            } else if (!parse_int(text, &value)) {
+                SDL_Log("%s:%d: %s is not a number: %s", path, line_no, key, text);
+                ok = 0;
+            } else if (value < limit_keys[i].lo || value > limit_keys[i].hi) {
+                SDL_Log("%s:%d: %s %d is out of range %d-%d", path, line_no, key, value, limit_keys[i].lo,
+                        limit_keys[i].hi);
+                ok = 0;
+            } else {
+                limits_set(l, key, value);
+            }
+        } else if (sscanf(line, " %63s", key) == 1) {
+            SDL_Log("%s:%d: expected key = value", path, line_no);
+            ok = 0;
+        }
+    }
+    fclose(fp);
+    return ok;
+}
+
+/* Pulls every limit into its supported range, saying so when one moves. */
+void limits_clamp(Limits *l) {
+    for (size_t i = 0; i < sizeof(limit_keys) / sizeof(limit_keys[0]); ++i) {
+        int *v = (int *)((char *)l + limit_keys[i].offset);
+        int clamped = *v < limit_keys[i].lo ? limit_keys[i].lo : *v > limit_keys[i].hi ? limit_keys[i].hi : *v;
+        if (clamped != *v) {
+            SDL_Log("%s %d out of range, using %d", limit_keys[i].key, *v, clamped);
+            *v = clamped;
+        }
+    }
+}
+
+/* -------------------- Profiler -------------------- */
+
+/* Per-frame phase timers and counters. Phases are bracketed with
+ * prof_begin()/prof_end(); timing is skipped entirely unless the overlay
+ * is shown or a trace is being written. Traces use the Chrome trace_event
+ * JSON format and open directly in Perfetto or chrome://tracing. */
+typedef enum {
+    PROF_EVENTS,
+    PROF_SOUNDS,
+    PROF_ALIENS,
+    PROF_COLLISIONS,
+    PROF_PARTICLES,
+    PROF_DRAW,
+    PROF_HUD,
+    PROF_PRESENT,
+    PROF_PHASE_COUNT
+} ProfPhase;
+
+typedef enum {
+    PROF_DRAW_CALLS,
+    PROF_FILL_RECTS,
+    PROF_VOICES,
+    PROF_LIVE_PARTICLES,
+    PROF_LAYER_DRAWS,
+    PROF_COUNTER_COUNT
+} ProfCounter;
+
+static const char *prof_phase_names[PROF_PHASE_COUNT] = {
+    "events", "sounds", "aliens", "collide", "particles", "draw", "hud", "present"
+};
+static const char *prof_counter_names[PROF_COUNTER_COUNT] = {
+    "draw_calls", "fill_rects", "voices", "particles", "layer_draws"
+};
+
+typedef struct {
+    int overlay;            /* main thread only */
+    SDL_atomic_t timing;    /* toggled on the main thread, read on the simulation thread */
+    Uint64 freq;
+    Uint64 phase_ticks[PROF_PHASE_COUNT];
+    float phase_ms[PROF_PHASE_COUNT];     /* smoothed, for the overlay */
+    int counters[PROF_COUNTER_COUNT];
+    int shown_counters[PROF_COUNTER_COUNT];
+    FILE *trace;
+    Uint64 trace_origin;
+    int trace_events;
+    SDL_SpinLock lock;      /* phases are also timed on the simulation thread */
+} Profiler;
+
+static Profiler profiler = {0};
+
+static inline Uint64 prof_begin(void) {
+    return SDL_AtomicGet(&profiler.timing) ? SDL_GetPerformanceCounter() : 0;
+}
+
+static double prof_us(Uint64 ticks) {
+    return (double)ticks * 1000000.0 / (double)profiler.freq;
+}
+
+static void prof_trace_sep(void) {
+    fputs(profiler.trace_events++ ? ",\n" : "\n", profiler.trace);
+}
+
+void prof_end(ProfPhase phase, Uint64 start) {
+    if (!SDL_AtomicGet(&profiler.timing) || !start) return;
+    Uint64 now = SDL_GetPerformanceCounter();
+    SDL_AtomicLock(&profiler.lock);
+    profiler.phase_ticks[phase] += now - start;
+    if (profiler.trace) {
+        prof_trace_sep();
+        fprintf(profiler.trace,
+                "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lu}",
+                prof_phase_names[phase], prof_us(start - profiler.trace_origin), prof_us(now - start),
+                (unsigned long)SDL_ThreadID());
+    }
+    SDL_AtomicUnlock(&profiler.lock);
+}
+
+static inline void prof_count(ProfCounter c, int n) {
+    profiler.counters[c] += n;
+}
+
+void prof_set_overlay(int on) {
+    profiler.overlay = on;
+    SDL_AtomicSet(&profiler.timing, profiler.overlay || profiler.trace);
+}
+
+int prof_open_trace(const char *path) {
+    profiler.trace = fopen(path, "w");
+    if (!profiler.trace) {
+        SDL_Log("Failed to open trace file %s", path);
+        return 0;
+    }
+    profiler.trace_origin = SDL_GetPerformanceCounter();
+    fputs("{\"traceEvents\":[", profiler.trace);
+    prof_set_overlay(profiler.overlay);
+    return 1;
+}
+
+void prof_close_trace(void) {
+    if (!profiler.trace) return;
+    SDL_AtomicLock(&profiler.lock);
+    fputs("\n]}\n", profiler.trace);
+    fclose(profiler.trace);
+    profiler.trace = NULL;
+    SDL_AtomicUnlock(&profiler.lock);
+    prof_set_overlay(profiler.overlay);
+}
+
+void prof_init(void) {
+    profiler.freq = SDL_GetPerformanceFrequency();
+}
+
+/* Publishes this frame's numbers to the overlay and trace, then resets. */
+void prof_frame_end(void) {
+    if (!SDL_AtomicGet(&profiler.timing)) {
+        memset(profiler.counters, 0, sizeof(profiler.counters));
+        return;
+    }
+    SDL_AtomicLock(&profiler.lock);
+    for (int i = 0; i < PROF_PHASE_COUNT; ++i) {
+        float ms = (float)(prof_us(profiler.phase_ticks[i]) / 1000.0);
+        profiler.phase_ms[i] += (ms - profiler.phase_ms[i]) * 0.1f;
+        profiler.phase_ticks[i] = 0;
+    }
+    if (profiler.trace) {
+        prof_trace_sep();
+        fprintf(profiler.trace, "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{",
+                prof_us(SDL_GetPerformanceCounter() - profiler.trace_origin));
+        for (int i = 0; i < PROF_COUNTER_COUNT; ++i) {
+            fprintf(profiler.trace, "%s\"%s\":%d", i ? "," : "", prof_counter_names[i], profiler.counters[i]);
+        }
+        fputs("}}", profiler.trace);
+    }
+    SDL_AtomicUnlock(&profiler.lock);
+    memcpy(profiler.shown_counters, profiler.counters, sizeof(profiler.counters));
+    memset(profiler.counters, 0, sizeof(profiler.counters));
+}
+
+/* -------------------- Draw List -------------------- */
+
+/* Per-frame command buffer for fill rects: they are collected into buckets
+ * by RGBA color and each bucket goes out in one SDL_RenderFillRects, with
+ * the draw color set once per bucket instead of before every rect. A rect
+ * that continues the previous one in its bucket on the same row is merged
+ * into it, so bitmap pixels become horizontal spans. Any other renderer
+ * submission flushes the list first, so rects never move across a texture
+ * copy, and a rect only joins an older bucket when it doesn't overlap
+ * anything queued after that bucket; the flushed result is the same as
+ * drawing in call order. */
+#define DRAW_BUCKETS 16
+#define DRAW_BUCKET_RECTS 256
+
+typedef struct {
+    uint32_t color;         /* 0xAARRGGBB */
+    SDL_Rect bounds;        /* of every rect in the bucket */
+    int count;
+    SDL_Rect rects[DRAW_BUCKET_RECTS];
+} DrawBucket;
+
+typedef struct {
+    uint32_t color;         /* current draw color, 0xAARRGGBB, for both backends */
+    uint32_t sdl_color;     /* last color handed to SDL_SetRenderDrawColor */
+    int sdl_color_valid;
+    int count;
+    DrawBucket buckets[DRAW_BUCKETS];
+} DrawList;
+
+static DrawList draw_list = {.color = 0xFF000000u};
+
+static inline SDL_Color unpack_argb(uint32_t c) {
+    return (SDL_Color){(Uint8)(c >> 16), (Uint8)(c >> 8), (Uint8)c, (Uint8)(c >> 24)};
+}
+
+/* Only touches the renderer's draw color when it actually changes. */
+static void draw_list_sync_color(SDL_Renderer *renderer, uint32_t color) {
+    if (draw_list.sdl_color_valid && draw_list.sdl_color == color) return;
+    SDL_Color c = unpack_argb(color);
+    SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+    draw_list.sdl_color = color;
+    draw_list.sdl_color_valid = 1;
+}
+
+void draw_list_flush(SDL_Renderer *renderer) {
+    for (int i = 0; i < draw_list.count; ++i) {
+        DrawBucket *b = &draw_list.buckets[i];
+        draw_list_sync_color(renderer, b->color);
+        prof_count(PROF_DRAW_CALLS, 1);
+        SDL_RenderFillRects(renderer, b->rects, b->count);
+    }
+    draw_list.count = 0;
+}
+
+static void rect_union(SDL_Rect *a, const SDL_Rect *b) {
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    a->x = a->x < b->x ? a->x : b->x;
+    a->y = a->y < b->y ? a->y : b->y;
+    a->w = x1 - a->x;
+    a->h = y1 - a->y;
+}
+
+void draw_list_add(SDL_Renderer *renderer, const SDL_Rect *r, uint32_t color) {
+    if (r->w <= 0 || r->h <= 0 || (color >> 24) == 0) return;
+    /* Newest bucket of this color that the rect can join without jumping
+     * over an overlapping rect of another color. */
+    DrawBucket *b = NULL;
+    for (int i = draw_list.count - 1; i >= 0; --i) {
+        if (draw_list.buckets[i].color == color) {
+            b = &draw_list.buckets[i];
+            break;
+        }
+        if (SDL_HasIntersection(&draw_list.buckets[i].bounds, r)) break;
+    }
+    if (b && b->count == DRAW_BUCKET_RECTS) {
+        draw_list_flush(renderer);
+        b = NULL;
+    }
+    if (!b) {
+        if (draw_list.count == DRAW_BUCKETS) draw_list_flush(renderer);
+        b = &draw_list.buckets[draw_list.count++];
+        b->color = color;
+        b->bounds = *r;
+        b->count = 0;
+    }
+    SDL_Rect *last = b->count > 0 ? &b->rects[b->count - 1] : NULL;
+    if (last && last->y == r->y && last->h == r->h && last->x + last->w == r->x) {
+        last->w += r->w;
+    } else {
+        b->rects[b->count++] = *r;
+    }
+    rect_union(&b->bounds, r);
+}
+
+/* -------------------- Software Framebuffer -------------------- */
+
+/* Optional CPU backend for machines where SDL itself renders in software:
+ * everything is drawn into an ARGB8888 buffer with span fills and uploaded
+ * in one SDL_UpdateTexture per frame, instead of paying SDL's per-call
+ * overhead for every tiny rect. Sprites and glyphs are blitted from packed
+ * bit rows, one span per run of lit pixels. */
+typedef struct {
+    int enabled;
+    uint32_t *pixels;
+    int w, h;
+    SDL_Texture *texture;   /* streaming upload target */
+} SoftFB;
+
+static SoftFB softfb = {0};
+
+int softfb_init(SDL_Renderer *renderer, int w, int h) {
+    softfb.pixels = malloc(sizeof(uint32_t) * (size_t)w * (size_t)h);
+    if (!softfb.pixels) return 0;
+    softfb.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                       SDL_TEXTUREACCESS_STREAMING, w, h);
+    if (!softfb.texture) {
+        SDL_Log("Failed to create framebuffer texture: %s", SDL_GetError());
+        free(softfb.pixels);
+        softfb.pixels = NULL;
+        return 0;
+    }
+    SDL_SetTextureBlendMode(softfb.texture, SDL_BLENDMODE_NONE);
+    softfb.w = w;
+    softfb.h = h;
+    softfb.enabled = 1;
+    return 1;
+}
+
+void softfb_free(void) {
+    if (softfb.texture) SDL_DestroyTexture(softfb.texture);
+    free(softfb.pixels);
+    memset(&softfb, 0, sizeof(softfb));
+}
+
+static inline uint32_t pack_argb(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    return (uint32_t)a << 24 | (uint32_t)r << 16 | (uint32_t)g << 8 | b;
+}
+
+/* Opaque span: two pixels per 64-bit store, or four per SSE2 store. */
+static void soft_span(uint32_t *dst, int n, uint32_t c) {
+    int i = 0;
+#ifdef __SSE2__
+    __m128i c4 = _mm_set1_epi32((int)c);
+    for (; i + 4 <= n; i += 4) _mm_storeu_si128((__m128i *)(dst + i), c4);
+#else
+    uint64_t c2 = (uint64_t)c << 32 | c;
+    for (; i + 2 <= n; i += 2) memcpy(dst + i, &c2, sizeof(c2));
+#endif
+    for (; i < n; ++i) dst[i] = c;
+}
+
+/* Source-over blend of c (alpha in its top byte) onto an opaque span. */
+static void soft_span_blend(uint32_t *dst, int n, uint32_t c) {
+    uint32_t a = c >> 24, ia = 255 - a;
+    uint32_t src_rb = (c & 0x00FF00FFu) * a, src_g = (c & 0x0000FF00u) * a;
+    for (int i = 0; i < n; ++i) {
+        uint32_t d = dst[i];
+        uint32_t rb = (src_rb + (d & 0x00FF00FFu) * ia + 0x00800080u) >> 8 & 0x00FF00FFu;
+        uint32_t g = (src_g + (d & 0x0000FF00u) * ia + 0x00008000u) >> 8 & 0x0000FF00u;
+        dst[i] = 0xFF000000u | rb | g;
+    }
+}
+
+static void soft_fill(int x, int y, int w, int h, uint32_t c) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > softfb.w) w = softfb.w - x;
+    if (y + h > softfb.h) h = softfb.h - y;
+    if (w <= 0 || h <= 0 || (c >> 24) == 0) return;
+    uint32_t *row = softfb.pixels + (size_t)y * (size_t)softfb.w + x;
+    for (int r = 0; r < h; ++r, row += softfb.w) {
+        if ((c >> 24) == 255) {
+            soft_span(row, w, c);
+        } else {
+            soft_span_blend(row, w, c);
+        }
+    }
+}
+
+/* Blits packed rows (bit w-1-col = lit) at the given scale in color c, one
+ * fill per horizontal run of lit pixels. */
+static void soft_blit_bits(const uint32_t *rows, int w, int h, int x, int y, int scale, uint32_t c) {
+    for (int r = 0; r < h; ++r) {
+        uint32_t bits = rows[r];
+        while (bits) {
+            int top = 31 - __builtin_clz(bits);
+            uint32_t v = bits << (31 - top);
+            int len = ~v ? __builtin_clz(~v) : 32;
+            soft_fill(x + (w - 1 - top) * scale, y + r * scale, len * scale, scale, c);
+            bits &= (uint32_t)(((uint64_t)1 << (top - len + 1)) - 1);
+        }
+    }
+}
+
+/* Counting wrappers for every renderer submission. While the software
+ * framebuffer is active they draw into it instead; otherwise fill rects go
+ * through the draw list and everything else flushes it first. */
+static inline void render_set_color(SDL_Renderer *renderer, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    (void)renderer;
+    draw_list.color = pack_argb(r, g, b, a);
+}
+
+static inline SDL_Color render_get_color(void) {
+    return unpack_argb(draw_list.color);
+}
+
+static inline void render_clear(SDL_Renderer *renderer) {
+    if (softfb.enabled) {
+        soft_fill(0, 0, softfb.w, softfb.h, draw_list.color | 0xFF000000u);
+        return;
+    }
+    draw_list.count = 0;   /* everything queued is covered */
+    draw_list_sync_color(renderer, draw_list.color);
+    prof_count(PROF_DRAW_CALLS, 1);
+    SDL_RenderClear(renderer);
+}
+
+static inline void render_fill_rect(SDL_Renderer *renderer, const SDL_Rect *rect) {
+    prof_count(PROF_FILL_RECTS, 1);
+    if (softfb.enabled) {
+        soft_fill(rect->x, rect->y, rect->w, rect->h, draw_list.color);
+        return;
+    }
+    draw_list_add(renderer, rect, draw_list.color);
+}
+
+static inline void render_copy(SDL_Renderer *renderer, SDL_Texture *texture,
+                               const SDL_Rect *src, const SDL_Rect *dst) {
+    draw_list_flush(renderer);
+    prof_count(PROF_DRAW_CALLS, 1);
+    SDL_RenderCopy(renderer, texture, src, dst);
+}
+
+static inline void render_geometry(SDL_Renderer *renderer, const SDL_Vertex *verts, int nverts,
+                                   const int *indices, int nindices) {
+    draw_list_flush(renderer);
+    prof_count(PROF_DRAW_CALLS, 1);
+    SDL_RenderGeometry(renderer, NULL, verts, nverts, indices, nindices);
+}
+
+static inline void render_set_target(SDL_Renderer *renderer, SDL_Texture *texture) {
+    draw_list_flush(renderer);
+    SDL_SetRenderTarget(renderer, texture);
+}
+
+/* Uploads the software framebuffer, if active, and presents. */
+static inline void render_present(SDL_Renderer *renderer) {
+    if (softfb.enabled) {
+        SDL_UpdateTexture(softfb.texture, NULL, softfb.pixels, softfb.w * (int)sizeof(uint32_t));
+        render_copy(renderer, softfb.texture, NULL, NULL);
+    }
+    draw_list_flush(renderer);
+    SDL_RenderPresent(renderer);
+}
+
 typedef struct {
     char c;
     uint8_t rows[7];
@@ -139,16 +871,31 @@ typedef struct {
 
 static const Glyph font[] = {
     {'A', {0x0E,0x11,0x11,0x1F,0x11,0x11,0x11}},
+    {'B', {0x1E,0x11,0x11,0x1E,0x11,0x11,0x1E}},
     {'C', {0x0E,0x11,0x10,0x10,0x10,0x11,0x0E}},
+    {'D', {0x1E,0x11,0x11,0x11,0x11,0x11,0x1E}},
     {'E', {0x1F,0x10,0x10,0x1E,0x10,0x10,0x1F}},
+    {'F', {0x1F,0x10,0x10,0x1E,0x10,0x10,0x10}},
     {'G', {0x0E,0x11,0x10,0x10,0x13,0x11,0x0E}},
+    {'H', {0x11,0x11,0x11,0x1F,0x11,0x11,0x11}},
+    {'I', {0x0E,0x04,0x04,0x04,0x04,0x04,0x0E}},
+    {'J', {0x07,0x02,0x02,0x02,0x02,0x12,0x0C}},
+    {'K', {0x11,0x12,0x14,0x18,0x14,0x12,0x11}},
+    {'L', {0x10,0x10,0x10,0x10,0x10,0x10,0x1F}},
     {'M', {0x11,0x1B,0x15,0x11,0x11,0x11,0x11}},
+    {'N', {0x11,0x11,0x19,0x15,0x13,0x11,0x11}},
     {'O', {0x0E,0x11,0x11,0x11,0x11,0x11,0x0E}},
     {'P', {0x1E,0x11,0x11,0x1E,0x10,0x10,0x10}},
+    {'Q', {0x0E,0x11,0x11,0x11,0x15,0x12,0x0D}},
     {'R', {0x1E,0x11,0x11,0x1E,0x14,0x12,0x11}},
     {'S', {0x0E,0x11,0x10,0x0E,0x01,0x11,0x0E}},
     {'T', {0x1F,0x04,0x04,0x04,0x04,0x04,0x04}},
+    {'U', {0x11,0x11,0x11,0x11,0x11,0x11,0x0E}},
     {'V', {0x11,0x11,0x11,0x11,0x11,0x0A,0x04}},
+    {'W', {0x11,0x11,0x11,0x15,0x15,0x15,0x0A}},
+    {'X', {0x11,0x11,0x0A,0x04,0x0A,0x11,0x11}},
+    {'Y', {0x11,0x11,0x0A,0x04,0x04,0x04,0x04}},
+    {'Z', {0x1F,0x01,0x02,0x04,0x08,0x10,0x1F}},
 };
 
 static const int digit_segments[10] = {
@@ -164,79 +911,272 @@ static const int digit_segments[10] = {
     0x6F  /* 9 */
 };
 
+/* Segment rectangles a..g of a 7-segment digit in font units (4x6 cell). */
+static const SDL_Rect digit_seg_layout[7] = {
+    {1, 0, 2, 1},  /* a */
+    {3, 1, 1, 2},  /* b */
+    {3, 3, 1, 2},  /* c */
+    {1, 5, 2, 1},  /* d */
+    {0, 3, 1, 2},  /* e */
+    {0, 1, 1, 2},  /* f */
+    {1, 3, 2, 1}   /* g */
+};
+
 void draw_digit_7seg(SDL_Renderer *renderer, int x, int y, int scale, int digit) {
     if (digit < 0 || digit > 9) return;
     int pattern = digit_segments[digit];
-    SDL_Rect seg[7] = {
-        {x + scale,     y,             2*scale, scale},      /* a */
-        {x + 3*scale,   y + scale,     scale,   2*scale},    /* b */
-        {x + 3*scale,   y + 3*scale,   scale,   2*scale},    /* c */
-        {x + scale,     y + 5*scale,   2*scale, scale},      /* d */
-        {x,             y + 3*scale,   scale,   2*scale},    /* e */
-        {x,             y + scale,     scale,   2*scale},    /* f */
-        {x + scale,     y + 3*scale,   2*scale, scale}       /* g */
-    };
     for (int i = 0; i < 7; ++i) {
         if (pattern & (1 << i)) {
-            SDL_RenderFillRect(renderer, &seg[i]);
+            const SDL_Rect *l = &digit_seg_layout[i];
+            SDL_Rect seg = {x + l->x * scale, y + l->y * scale, l->w * scale, l->h * scale};
+            render_fill_rect(renderer, &seg);
         }
     }
 }
 
-void draw_number(SDL_Renderer *renderer, int x, int y, int scale, int value) {
-    char buf[16];
-    sprintf(buf, "%d", value);
-    for (int i = 0; buf[i]; ++i) {
-        draw_digit_7seg(renderer, x, y, scale, buf[i] - '0');
-        x += 5 * scale;
-    }
+/* -------------------- Text -------------------- */
+
+/* Block letters and 7-segment digits are rasterized once into a glyph atlas
+ * at one texel per font unit and scaled on copy. Strings that rarely change
+ * (HUD labels, banners) are additionally cached as whole textures. */
+#define GLYPH_W 5
+#define GLYPH_H 7
+#define GLYPH_ADVANCE 6
+#define DIGIT_W 4
+#define DIGIT_H 6
+#define DIGIT_ADVANCE 5
+#define GLYPH_MAX 48
+
+typedef struct {
+    uint8_t rows[GLYPH_H];  /* bit (w - 1 - col) set = lit */
+    int w, h;
+} GlyphBits;
+
+static GlyphBits glyphs[GLYPH_MAX];
+static int glyph_count = 0;
+static int8_t glyph_lookup[256];  /* char -> glyph index, -1 = blank */
+static int8_t digit_glyph[10];
+static SDL_Texture *glyph_texture = NULL;
+static SDL_Rect glyph_src[GLYPH_MAX];
+
+static int add_glyph(const uint8_t *rows, int w, int h) {
+    GlyphBits *g = &glyphs[glyph_count];
+    memset(g, 0, sizeof(*g));
+    memcpy(g->rows, rows, (size_t)h);
+    g->w = w;
+    g->h = h;
+    return glyph_count++;
 }
 
-static const uint8_t* glyph_for(char c) {
-    c = toupper((unsigned char)c);
+static void init_glyphs(void) {
+    static const uint8_t dash[GLYPH_H]  = {0x00,0x00,0x00,0x1F,0x00,0x00,0x00};
+    static const uint8_t colon[GLYPH_H] = {0x00,0x04,0x00,0x00,0x04,0x00,0x00};
+    if (glyph_count) return;
+    memset(glyph_lookup, -1, sizeof(glyph_lookup));
     for (size_t i = 0; i < sizeof(font)/sizeof(font[0]); ++i) {
-        if (font[i].c == c) return font[i].rows;
+        int idx = add_glyph(font[i].rows, GLYPH_W, GLYPH_H);
+        glyph_lookup[(unsigned char)font[i].c] = (int8_t)idx;
+        glyph_lookup[(unsigned char)tolower((unsigned char)font[i].c)] = (int8_t)idx;
+    }
+    glyph_lookup['-'] = (int8_t)add_glyph(dash, GLYPH_W, GLYPH_H);
+    glyph_lookup[':'] = (int8_t)add_glyph(colon, GLYPH_W, GLYPH_H);
+    for (int d = 0; d < 10; ++d) {
+        uint8_t rows[DIGIT_H] = {0};
+        for (int i = 0; i < 7; ++i) {
+            if (!(digit_segments[d] & (1 << i))) continue;
+            const SDL_Rect *l = &digit_seg_layout[i];
+            for (int y = l->y; y < l->y + l->h; ++y) {
+                for (int x = l->x; x < l->x + l->w; ++x) rows[y] |= (uint8_t)(1 << (DIGIT_W - 1 - x));
+            }
+        }
+        digit_glyph[d] = (int8_t)add_glyph(rows, DIGIT_W, DIGIT_H);
     }
-    return NULL;
 }
 
-int text_width_block(const char *text, int scale) {
-    size_t len = strlen(text);
-    if (len == 0) return 0;
-    return (int)((len * 6 - 1) * scale);
-}
+int build_glyph_atlas(SDL_Renderer *renderer) {
+    init_glyphs();
 
-void draw_char_block(SDL_Renderer *renderer, int x, int y, int scale, char c) {
-    if (c == ' ') return;  /* spacing handled by caller */
-    if (c == '-') {
-        SDL_Rect r = {x, y + 3*scale, 5*scale, scale};
-        SDL_RenderFillRect(renderer, &r);
-        return;
+    int atlas_w = 1;
+    for (int i = 0; i < glyph_count; ++i) {
+        glyph_src[i] = (SDL_Rect){atlas_w, 1, glyphs[i].w, glyphs[i].h};
+        atlas_w += glyphs[i].w + 1;
+    }
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, atlas_w, GLYPH_H + 2, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface) {
+        SDL_Log("Failed to create glyph surface: %s", SDL_GetError());
+        return 0;
     }
-    if (c == ':') {
-        SDL_Rect r = {x + 2*scale, y + scale, scale, scale};
-        SDL_RenderFillRect(renderer, &r);
-        r.y = y + 4*scale;
-        SDL_RenderFillRect(renderer, &r);
+    SDL_FillRect(surface, NULL, SDL_MapRGBA(surface->format, 0, 0, 0, 0));
+    Uint32 white = SDL_MapRGBA(surface->format, 255, 255, 255, 255);
+    for (int i = 0; i < glyph_count; ++i) {
+        const GlyphBits *g = &glyphs[i];
+        for (int row = 0; row < g->h; ++row) {
+            Uint32 *dst = (Uint32 *)((Uint8 *)surface->pixels + (glyph_src[i].y + row) * surface->pitch);
+            for (int col = 0; col < g->w; ++col) {
+                if (g->rows[row] & (1 << (g->w - 1 - col))) dst[glyph_src[i].x + col] = white;
+            }
+        }
+    }
+
+    glyph_texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_FreeSurface(surface);
+    if (!glyph_texture) {
+        SDL_Log("Failed to create glyph atlas: %s", SDL_GetError());
+        return 0;
+    }
+    SDL_SetTextureBlendMode(glyph_texture, SDL_BLENDMODE_BLEND);
+    return 1;
+}
+
+void destroy_glyph_atlas(void) {
+    if (glyph_texture) SDL_DestroyTexture(glyph_texture);
+    glyph_texture = NULL;
+}
+
+/* Draws one glyph in the renderer's current draw color. */
+static void draw_glyph(SDL_Renderer *renderer, int x, int y, int scale, int idx) {
+    const GlyphBits *g = &glyphs[idx];
+    if (softfb.enabled) {
+        uint32_t rows[GLYPH_H];
+        for (int r = 0; r < g->h; ++r) rows[r] = g->rows[r];
+        soft_blit_bits(rows, g->w, g->h, x, y, scale, draw_list.color);
         return;
     }
-    const uint8_t *rows = glyph_for(c);
-    if (!rows) return;
-    for (int r = 0; r < 7; ++r) {
-        for (int col = 0; col < 5; ++col) {
-            if (rows[r] & (1 << (4 - col))) {
-                SDL_Rect px = {x + col*scale, y + r*scale, scale, scale};
-                SDL_RenderFillRect(renderer, &px);
+    if (!glyph_texture) {
+        for (int r = 0; r < g->h; ++r) {
+            for (int col = 0; col < g->w; ++col) {
+                if (g->rows[r] & (1 << (g->w - 1 - col))) {
+                    SDL_Rect px = {x + col*scale, y + r*scale, scale, scale};
+                    render_fill_rect(renderer, &px);
+                }
             }
         }
+        return;
+    }
+    SDL_Color c = render_get_color();
+    SDL_SetTextureColorMod(glyph_texture, c.r, c.g, c.b);
+    SDL_SetTextureAlphaMod(glyph_texture, c.a);
+    SDL_Rect dst = {x, y, g->w * scale, g->h * scale};
+    render_copy(renderer, glyph_texture, &glyph_src[idx], &dst);
+}
+
+void draw_number(SDL_Renderer *renderer, int x, int y, int scale, int value) {
+    char buf[16];
+    sprintf(buf, "%d", value);
+    for (int i = 0; buf[i]; ++i) {
+        if (buf[i] >= '0' && buf[i] <= '9') draw_glyph(renderer, x, y, scale, digit_glyph[buf[i] - '0']);
+        x += DIGIT_ADVANCE * scale;
     }
 }
 
+int text_width_block(const char *text, int scale) {
+    size_t len = strlen(text);
+    if (len == 0) return 0;
+    return (int)((len * GLYPH_ADVANCE - 1) * scale);
+}
+
+void draw_char_block(SDL_Renderer *renderer, int x, int y, int scale, char c) {
+    int idx = glyph_lookup[(unsigned char)c];
+    if (idx >= 0) draw_glyph(renderer, x, y, scale, idx);
+}
+
 void draw_text_block(SDL_Renderer *renderer, int x, int y, int scale, const char *text) {
     for (int i = 0; text[i]; ++i) {
         draw_char_block(renderer, x, y, scale, text[i]);
-        x += 6 * scale;
+        x += GLYPH_ADVANCE * scale;
+    }
+}
+
+/* A cached "TEXT<value>" string. The texture is rebuilt only when the text
+ * or value differs from what was last rendered into it. */
+#define LABEL_NO_VALUE (-1)
+
+typedef struct {
+    char text[40];
+    int value;
+    int valid;
+    SDL_Texture *texture;
+    int tex_w;
+    int w, h;  /* font units */
+} TextLabel;
+
+static int label_layout_width(const char *text, int value) {
+    int w = text_width_block(text, 1);
+    if (value != LABEL_NO_VALUE) {
+        char buf[16];
+        int n = sprintf(buf, "%d", value);
+        if (w > 0) w += 1;
+        w += n * DIGIT_ADVANCE - 1;
     }
+    return w;
+}
+
+static int render_label(SDL_Renderer *renderer, TextLabel *label, const char *text, int value) {
+    int w = label_layout_width(text, value);
+    if (w <= 0) w = 1;
+    if (!label->texture || label->tex_w < w) {
+        if (label->texture) SDL_DestroyTexture(label->texture);
+        label->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                           SDL_TEXTUREACCESS_TARGET, w, GLYPH_H);
+        if (!label->texture) return 0;
+        SDL_SetTextureBlendMode(label->texture, SDL_BLENDMODE_BLEND);
+        label->tex_w = w;
+    }
+
+    /* Labels may be re-rendered while a layer is the current target. */
+    SDL_Texture *target = SDL_GetRenderTarget(renderer);
+    SDL_Color c = render_get_color();
+    render_set_target(renderer, label->texture);
+    render_set_color(renderer, 0, 0, 0, 0);
+    render_clear(renderer);
+    render_set_color(renderer, 255, 255, 255, 255);
+    draw_text_block(renderer, 0, 0, 1, text);
+    if (value != LABEL_NO_VALUE) {
+        int x = text_width_block(text, 1);
+        draw_number(renderer, x > 0 ? x + 1 : 0, 0, 1, value);
+    }
+    render_set_target(renderer, target);
+    render_set_color(renderer, c.r, c.g, c.b, c.a);
+
+    snprintf(label->text, sizeof(label->text), "%s", text);
+    label->value = value;
+    label->w = w;
+    label->h = GLYPH_H;
+    label->valid = 1;
+    return 1;
+}
+
+/* Draws text followed by an optional 7-segment value in the current draw
+ * color, re-rendering the cached texture only when the content changed. */
+void draw_label(SDL_Renderer *renderer, TextLabel *label, int x, int y, int scale,
+                const char *text, int value) {
+    if (softfb.enabled || !glyph_texture || !SDL_RenderTargetSupported(renderer)) {
+        draw_text_block(renderer, x, y, scale, text);
+        if (value != LABEL_NO_VALUE) {
+            int tw = text_width_block(text, scale);
+            draw_number(renderer, tw > 0 ? x + tw + scale : x, y, scale, value);
+        }
+        return;
+    }
+    if (!label->valid || label->value != value || strcmp(label->text, text) != 0) {
+        if (!render_label(renderer, label, text, value)) return;
+    }
+    SDL_Color c = render_get_color();
+    SDL_SetTextureColorMod(label->texture, c.r, c.g, c.b);
+    SDL_SetTextureAlphaMod(label->texture, c.a);
+    SDL_Rect src = {0, 0, label->w, label->h};
+    SDL_Rect dst = {x, y, label->w * scale, label->h * scale};
+    render_copy(renderer, label->texture, &src, &dst);
+}
+
+void invalidate_label(TextLabel *label) {
+    label->valid = 0;
+}
+
+void destroy_label(TextLabel *label) {
+    if (label->texture) SDL_DestroyTexture(label->texture);
+    memset(label, 0, sizeof(*label));
 }
 
 void draw_bitmap(SDL_Renderer *renderer, int x, int y, int scale,
@@ -245,13 +1185,13 @@ void draw_bitmap(SDL_Renderer *renderer, int x, int y, int scale,
         for (int col = 0; col < w; ++col) {
             if (bitmap[row * w + col]) {
                 SDL_Rect px = {x + col * scale, y + row * scale, scale, scale};
-                SDL_RenderFillRect(renderer, &px);
+                render_fill_rect(renderer, &px);
             }
         }
     }
 }
 
-static const uint8_t alien_bitmaps[ALIEN_ROWS][2][ALIEN_BMP_W * ALIEN_BMP_H] = {
+static const uint8_t alien_bitmaps[ALIEN_TYPES][2][ALIEN_BMP_W * ALIEN_BMP_H] = {
     {
         { 0,0,1,1,1,1,1,1,0,0,
           0,1,1,0,0,0,0,1,1,0,
@@ -297,291 +1237,3272 @@ static const uint8_t ship_bitmap[SHIP_BMP_W * SHIP_BMP_H] = {
     1,1,1,1,1,1,1,1,1,1,1,1
 };
 
+/* -------------------- Sprite Atlas -------------------- */
+
+/* Every sprite bitmap is rasterized once into a single white texture; the
+ * draw color comes from SDL_SetTextureColorMod, so a sprite costs one copy
+ * regardless of how many pixels it has. */
+#define SPRITE_ALIEN(type, frame) ((type) * 2 + (frame))
+#define SPRITE_SHIP (ALIEN_TYPES * 2)
+#define SPRITE_COUNT (SPRITE_SHIP + 1)
+
+#define SPRITE_MAX_H 8
+
+typedef struct {
+    const uint8_t *bitmap;
+    int w, h;
+    uint32_t rows[SPRITE_MAX_H];  /* packed, bit (w - 1 - col) = lit */
+} SpriteDef;
+
+typedef struct {
+    SDL_Texture *texture;
+    SDL_Rect src[SPRITE_COUNT];
+} SpriteAtlas;
+
+static SpriteDef sprite_defs[SPRITE_COUNT];
+static SpriteAtlas atlas = {0};
+
+static void init_sprite_defs(void) {
+    for (int t = 0; t < ALIEN_TYPES; ++t) {
+        for (int f = 0; f < 2; ++f) {
+            sprite_defs[SPRITE_ALIEN(t, f)] = (SpriteDef){.bitmap = alien_bitmaps[t][f], .w = ALIEN_BMP_W, .h = ALIEN_BMP_H};
+        }
+    }
+    sprite_defs[SPRITE_SHIP] = (SpriteDef){.bitmap = ship_bitmap, .w = SHIP_BMP_W, .h = SHIP_BMP_H};
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        SpriteDef *def = &sprite_defs[i];
+        for (int row = 0; row < def->h; ++row) {
+            for (int col = 0; col < def->w; ++col) {
+                if (def->bitmap[row * def->w + col]) def->rows[row] |= 1u << (def->w - 1 - col);
+            }
+        }
+    }
+}
+
+int build_sprite_atlas(SDL_Renderer *renderer) {
+    init_sprite_defs();
+
+    /* Lay sprites out left to right with a 1px transparent gutter. */
+    int atlas_w = 1, atlas_h = 1;
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        atlas.src[i] = (SDL_Rect){atlas_w, 1, sprite_defs[i].w, sprite_defs[i].h};
+        atlas_w += sprite_defs[i].w + 1;
+        if (sprite_defs[i].h + 2 > atlas_h) atlas_h = sprite_defs[i].h + 2;
+    }
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, atlas_w, atlas_h, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface) {
+        SDL_Log("Failed to create sprite surface: %s", SDL_GetError());
+        return 0;
+    }
+    SDL_FillRect(surface, NULL, SDL_MapRGBA(surface->format, 0, 0, 0, 0));
+    Uint32 white = SDL_MapRGBA(surface->format, 255, 255, 255, 255);
+    for (int i = 0; i < SPRITE_COUNT; ++i) {
+        const SpriteDef *def = &sprite_defs[i];
+        for (int row = 0; row < def->h; ++row) {
+            Uint32 *dst = (Uint32 *)((Uint8 *)surface->pixels + (atlas.src[i].y + row) * surface->pitch);
+            for (int col = 0; col < def->w; ++col) {
+                if (def->bitmap[row * def->w + col]) dst[atlas.src[i].x + col] = white;
+            }
+        }
+    }
+
+    atlas.texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_FreeSurface(surface);
+    if (!atlas.texture) {
+        SDL_Log("Failed to create sprite atlas: %s", SDL_GetError());
+        return 0;
+    }
+    SDL_SetTextureBlendMode(atlas.texture, SDL_BLENDMODE_BLEND);
+    return 1;
+}
+
+void destroy_sprite_atlas(void) {
+    if (atlas.texture) SDL_DestroyTexture(atlas.texture);
+    atlas.texture = NULL;
+}
+
+void draw_sprite(SDL_Renderer *renderer, int sprite, int x, int y, int scale, SDL_Color color) {
+    const SpriteDef *def = &sprite_defs[sprite];
+    if (softfb.enabled) {
+        soft_blit_bits(def->rows, def->w, def->h, x, y, scale, pack_argb(color.r, color.g, color.b, color.a));
+        return;
+    }
+    if (!atlas.texture) {
+        /* Atlas creation failed; fall back to per-pixel rects. */
+        render_set_color(renderer, color.r, color.g, color.b, color.a);
+        draw_bitmap(renderer, x, y, scale, def->bitmap, def->w, def->h);
+        return;
+    }
+    SDL_Rect dst = {x, y, def->w * scale, def->h * scale};
+    SDL_SetTextureColorMod(atlas.texture, color.r, color.g, color.b);
+    render_copy(renderer, atlas.texture, &atlas.src[sprite], &dst);
+}
+
 /* -------------------- Audio -------------------- */
 
-static double envelope_amp(ActiveSound *s) {
-    double t = s->t;
-    double a = s->env.attack;
-    double d = s->env.decay;
-    double sus = s->env.sustain;
-    double r = s->env.release;
-    double level = s->env.sustain_level;
-    if (t < a) return t / a;
-    if (t < a + d) return 1.0 - (1.0 - level) * (t - a) / d;
-    if (t < a + d + sus) return level;
-    if (t < s->total) return level * (1.0 - (t - (a + d + sus)) / r);
-    s->active = 0;
-    return 0.0;
+#define WAVETABLE_BITS 11
+#define WAVETABLE_SIZE (1 << WAVETABLE_BITS)
+#define MIX_BLOCK 256
+#define MIX_GAIN 3000.0f
+
+/* One extra entry so linear interpolation never wraps. */
+static float sine_table[WAVETABLE_SIZE + 1];
+static Uint32 noise_seed = 0x9E3779B9u;
+
+void init_wavetables(void) {
+    for (int i = 0; i <= WAVETABLE_SIZE; ++i) {
+        sine_table[i] = (float)sin(2.0 * M_PI * i / WAVETABLE_SIZE);
+    }
+}
+
+static inline float osc_sine(Uint32 phase) {
+    Uint32 idx = phase >> (32 - WAVETABLE_BITS);
+    float frac = (float)(phase & ((1u << (32 - WAVETABLE_BITS)) - 1)) * (1.0f / (1u << (32 - WAVETABLE_BITS)));
+    return sine_table[idx] + (sine_table[idx + 1] - sine_table[idx]) * frac;
+}
+
+/* Band-limited step correction for the square's two discontinuities. */
+static inline float poly_blep(float t, float dt) {
+    if (t < dt) {
+        t /= dt;
+        return t + t - t * t - 1.0f;
+    }
+    if (t > 1.0f - dt) {
+        t = (t - 1.0f) / dt;
+        return t * t + t + t + 1.0f;
+    }
+    return 0.0f;
+}
+
+static inline float osc_square(Uint32 phase, float dt) {
+    const float to_unit = 1.0f / 4294967296.0f;
+    float t = (float)phase * to_unit;
+    float v = phase < 0x80000000u ? 1.0f : -1.0f;
+    v += poly_blep(t, dt);
+    v -= poly_blep((float)(phase + 0x80000000u) * to_unit, dt);
+    return v;
+}
+
+static inline float osc_noise(Uint32 *state) {
+    Uint32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (float)(Sint32)x * (1.0f / 2147483648.0f);
+}
+
+/* Level the envelope reaches at the end of each stage. */
+static float env_stage_target(const ActiveSound *v) {
+    switch (v->stage) {
+        case ENV_ATTACK:  return 1.0f;
+        case ENV_DECAY:   return v->sustain_level;
+        case ENV_SUSTAIN: return v->sustain_level;
+        default:          return 0.0f;
+    }
+}
+
+/* Adds n samples of voice v into mix, one envelope segment at a time. */
+static void render_voice(ActiveSound *v, float *mix, int n) {
+    if (v->start >= n) {
+        v->start -= n;
+        return;
+    }
+    mix += v->start;
+    n -= v->start;
+    v->start = 0;
+    int pos = 0;
+    while (pos < n) {
+        while (v->stage != ENV_DONE && v->stage_left == 0) {
+            v->stage++;
+            if (v->stage != ENV_DONE) v->stage_left = v->stage_len[v->stage];
+            if (v->stage == ENV_SUSTAIN) v->amp = v->sustain_level;
+        }
+        if (v->stage == ENV_DONE) {
+            v->active = 0;
+            return;
+        }
+        int count = n - pos;
+        if (count > v->stage_left) count = v->stage_left;
+        float amp = v->amp;
+        float inc = (env_stage_target(v) - amp) / (float)v->stage_left;
+        Uint32 phase = v->phase;
+        Uint32 step = v->phase_inc;
+        float *out = mix + pos;
+        switch (v->wave) {
+            case WAVE_SINE:
+                for (int i = 0; i < count; ++i) {
+                    out[i] += osc_sine(phase) * amp;
+                    phase += step;
+                    amp += inc;
+                }
+                break;
+            case WAVE_SQUARE: {
+                float dt = (float)step * (1.0f / 4294967296.0f);
+                for (int i = 0; i < count; ++i) {
+                    out[i] += osc_square(phase, dt) * amp;
+                    phase += step;
+                    amp += inc;
+                }
+                break;
+            }
+            case WAVE_NOISE:
+                for (int i = 0; i < count; ++i) {
+                    out[i] += osc_noise(&v->noise) * amp;
+                    amp += inc;
+                }
+                break;
+        }
+        v->phase = phase;
+        v->amp = amp;
+        v->stage_left -= count;
+        pos += count;
+    }
+}
+
+static int sound_queue_push(SoundQueue *q, const SoundCmd *cmd) {
+    unsigned head = (unsigned)SDL_AtomicGet(&q->head);
+    unsigned tail = (unsigned)SDL_AtomicGet(&q->tail);
+    if (head - tail >= SOUND_QUEUE_SIZE) {
+        SDL_AtomicAdd(&q->dropped, 1);
+        return 0;
+    }
+    q->cmds[head & (SOUND_QUEUE_SIZE - 1)] = *cmd;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&q->head, (int)(head + 1));
+    return 1;
+}
+
+/* Advances the stream clock by the buffer about to be mixed. It runs one
+ * buffer behind the callback and is re-anchored there when the device stalls
+ * or the callbacks drift, so timestamps stay within the buffer they belong to. */
+static void audio_clock_advance(Uint64 now, int frames) {
+    Uint64 period = (Uint64)frames * SDL_GetPerformanceFrequency() / (Uint64)audio.freq;
+    if (audio.last_callback && now - audio.last_callback > 2 * period) audio.underruns++;
+    audio.last_callback = now;
+    audio.callbacks++;
+    Uint64 anchor = now > period ? now - period : 0;
+    Uint64 start = audio.stream_next;
+    if (start + period < anchor || start > anchor + period) start = anchor;
+    audio.stream_start = start;
+    audio.stream_next = start + period;
+}
+
+/* Samples into the current buffer at which a sound stamped `when` starts,
+ * and the latency from its timestamp to playout: mixed at now plus the
+ * offset, behind one device buffer. */
+static int audio_start_offset(Uint64 when, Uint64 now) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    int offset = 0;
+    if (when < audio.stream_start) {
+        audio.late++;
+    } else {
+        offset = (int)((when - audio.stream_start) * (Uint64)audio.freq / freq);
+    }
+    Uint64 heard = now + (Uint64)offset * freq / (Uint64)audio.freq;
+    double ms = heard > when ? (double)(heard - when) * 1000.0 / (double)freq : 0.0;
+    ms += audio.buffer * 1000.0 / audio.freq;
+    audio.latency_sum += ms;
+    if (ms > audio.latency_max) audio.latency_max = ms;
+    audio.latency_count++;
+    return offset;
+}
+
+/* How loud a voice still is, for picking one to steal: clips fade out over
+ * their length, synth voices still rising to their peak count as full. */
+static float sample_voice_level(const SampleVoice *v) {
+    return v->gain * (float)(v->len - v->pos) / (float)v->len;
+}
+
+static float synth_voice_level(const ActiveSound *v) {
+    return v->stage <= ENV_DECAY ? 1.0f : v->amp;
+}
+
+/* The voice to give up for a sound of `priority`, or -1 if every busy voice
+ * outranks it. */
+static int steal_sample_voice(int priority) {
+    int best = -1;
+    for (int s = 0; s < sample_capacity; ++s) {
+        const SampleVoice *v = &sample_voices[s];
+        if (v->priority > priority) continue;
+        if (best < 0 || v->priority < sample_voices[best].priority ||
+            (v->priority == sample_voices[best].priority && sample_voice_level(v) < sample_voice_level(&sample_voices[best]))) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+static int steal_synth_voice(int priority) {
+    int best = -1;
+    for (int s = 0; s < sound_capacity; ++s) {
+        const ActiveSound *v = &sounds[s];
+        if (v->priority > priority) continue;
+        if (best < 0 || v->priority < sounds[best].priority ||
+            (v->priority == sounds[best].priority && synth_voice_level(v) < synth_voice_level(&sounds[best]))) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+/* Audio thread: move every queued command into a free voice, or a stolen
+ * one, starting at the sample its timestamp maps to. */
+static void sound_queue_drain(SoundQueue *q, Uint64 now) {
+    unsigned tail = (unsigned)SDL_AtomicGet(&q->tail);
+    unsigned head = (unsigned)SDL_AtomicGet(&q->head);
+    SDL_MemoryBarrierAcquire();
+    int synth_slot = 0, sample_slot = 0;
+    for (; tail != head; ++tail) {
+        const SoundCmd *cmd = &q->cmds[tail & (SOUND_QUEUE_SIZE - 1)];
+        if (cmd->type == CMD_SAMPLE) {
+            while (sample_slot < sample_capacity && sample_voices[sample_slot].data) sample_slot++;
+            int slot = sample_slot < sample_capacity ? sample_slot : steal_sample_voice(cmd->sample.priority);
+            if (slot < 0) {
+                SDL_AtomicAdd(&q->no_voice, 1);
+                continue;
+            }
+            if (slot != sample_slot) SDL_AtomicAdd(&q->stolen, 1);
+            sample_voices[slot] = cmd->sample;
+            sample_voices[slot].start = audio_start_offset(cmd->when, now);
+        } else {
+            while (synth_slot < sound_capacity && sounds[synth_slot].active) synth_slot++;
+            int slot = synth_slot < sound_capacity ? synth_slot : steal_synth_voice(cmd->synth.priority);
+            if (slot < 0) {
+                SDL_AtomicAdd(&q->no_voice, 1);
+                continue;
+            }
+            if (slot != synth_slot) SDL_AtomicAdd(&q->stolen, 1);
+            sounds[slot] = cmd->synth;
+            sounds[slot].start = audio_start_offset(cmd->when, now);
+        }
+    }
+    SDL_AtomicSet(&q->tail, (int)tail);
+}
+
+static void render_sample_voice(SampleVoice *v, float *mix, int n) {
+    if (v->start >= n) {
+        v->start -= n;
+        return;
+    }
+    mix += v->start;
+    n -= v->start;
+    v->start = 0;
+    int count = v->len - v->pos;
+    if (count > n) count = n;
+    const float *src = v->data + v->pos;
+    float gain = v->gain;
+    for (int i = 0; i < count; ++i) mix[i] += src[i] * gain;
+    v->pos += count;
+    if (v->pos >= v->len) v->data = NULL;
 }
 
 void audio_callback(void *userdata, Uint8 *stream, int len) {
     (void)userdata;
     Sint16 *buffer = (Sint16 *)stream;
     int length = len / 2;
-    for (int i = 0; i < length; ++i) {
-        double sample = 0.0;
-        for (int s = 0; s < MAX_ACTIVE_SOUNDS; ++s) {
-            if (!sounds[s].active) continue;
-            ActiveSound *as = &sounds[s];
-            double amp = envelope_amp(as);
-            double val = 0.0;
-            switch (as->wave) {
-                case WAVE_SINE:   val = sin(as->phase); break;
-                case WAVE_SQUARE: val = sin(as->phase) > 0 ? 1.0 : -1.0; break;
-                case WAVE_NOISE:  val = ((rand() % 20001) / 10000.0) - 1.0; break;
+    Uint64 now = SDL_GetPerformanceCounter();
+    audio_clock_advance(now, length);
+    sound_queue_drain(&sound_queue, now);
+    float mix[MIX_BLOCK];
+    int voices = 0;
+    for (int s = 0; s < sample_capacity; ++s) voices += sample_voices[s].data != NULL;
+    for (int s = 0; s < sound_capacity; ++s) voices += sounds[s].active;
+    SDL_AtomicSet(&audio.voices, voices);
+    for (int base = 0; base < length; base += MIX_BLOCK) {
+        int n = length - base < MIX_BLOCK ? length - base : MIX_BLOCK;
+        memset(mix, 0, sizeof(float) * (size_t)n);
+        for (int s = 0; s < sample_capacity; ++s) {
+            if (sample_voices[s].data) render_sample_voice(&sample_voices[s], mix, n);
+        }
+        for (int s = 0; s < sound_capacity; ++s) {
+            if (sounds[s].active) render_voice(&sounds[s], mix, n);
+        }
+        for (int i = 0; i < n; ++i) {
+            float sample = mix[i];
+            if (sample > 1.0f) sample = 1.0f;
+            if (sample < -1.0f) sample = -1.0f;
+            buffer[base + i] = (Sint16)(sample * MIX_GAIN);
+        }
+    }
+}
+
+static int ms_to_samples(double ms) {
+    if (ms <= 0) return 0;
+    return (int)(ms * audio.freq / 1000.0 + 0.5);
+}
+
+static ActiveSound make_voice(double freq, int dur_ms, Waveform wave, ADSR env) {
+    ActiveSound v;
+    memset(&v, 0, sizeof(v));
+    v.active = 1;
+    v.wave = wave;
+    v.phase_inc = (Uint32)(freq / audio.freq * 4294967296.0);
+    v.sustain_level = (float)env.sustain_level;
+    v.stage_len[ENV_ATTACK] = ms_to_samples(env.attack);
+    v.stage_len[ENV_DECAY] = ms_to_samples(env.decay);
+    v.stage_len[ENV_RELEASE] = ms_to_samples(env.release);
+    int sustain = ms_to_samples(dur_ms) -
+                  (v.stage_len[ENV_ATTACK] + v.stage_len[ENV_DECAY] + v.stage_len[ENV_RELEASE]);
+    v.stage_len[ENV_SUSTAIN] = sustain > 0 ? sustain : 0;
+    v.stage = ENV_ATTACK;
+    v.stage_left = v.stage_len[ENV_ATTACK];
+    v.amp = 0.0f;
+    noise_seed = noise_seed * 1664525u + 1013904223u;
+    v.noise = noise_seed | 1u;
+    return v;
+}
+
+/* Synthesizes a voice live; for sounds whose parameters aren't known up
+ * front. It starts at perf counter time `when`. */
+void play_beep(double freq, int dur_ms, Waveform wave, ADSR env, Uint64 when, int priority) {
+    if (!audio.device) return;
+    SoundCmd cmd;
+    cmd.type = CMD_SYNTH;
+    cmd.when = when;
+    cmd.synth = make_voice(freq, dur_ms, wave, env);
+    cmd.synth.priority = priority;
+    sound_queue_push(&sound_queue, &cmd);
+}
+
+void play_sample(SoundEvent e, float gain, Uint64 when) {
+    if (!audio.device || !sound_bank[e].data) return;
+    SoundCmd cmd;
+    cmd.type = CMD_SAMPLE;
+    cmd.when = when;
+    cmd.sample = (SampleVoice){sound_bank[e].data, sound_bank[e].len, 0, gain, 0, sound_priority[e]};
+    sound_queue_push(&sound_queue, &cmd);
+}
+
+/* Renders every event once at the device rate. Must run before the device
+ * is unpaused; a clip that fails to allocate falls back to live synthesis. */
+void build_sound_bank(void) {
+    for (int e = 0; e < SND_COUNT; ++e) {
+        int len = 0;
+        for (size_t i = 0; i < sizeof(sfx_defs) / sizeof(sfx_defs[0]); ++i) {
+            const PendingSound *l = &sfx_defs[i].layer;
+            if ((int)sfx_defs[i].event != e) continue;
+            int end = ms_to_samples(l->delay_ms + l->dur_ms);
+            if (end > len) len = end;
+        }
+        float *data = len > 0 ? calloc((size_t)len, sizeof(float)) : NULL;
+        if (!data) continue;
+        for (size_t i = 0; i < sizeof(sfx_defs) / sizeof(sfx_defs[0]); ++i) {
+            const PendingSound *l = &sfx_defs[i].layer;
+            if ((int)sfx_defs[i].event != e) continue;
+            ActiveSound v = make_voice(l->freq, l->dur_ms, l->wave, l->env);
+            int start = ms_to_samples(l->delay_ms);
+            render_voice(&v, data + start, len - start);
+        }
+        sound_bank[e] = (SoundClip){data, len};
+    }
+}
+
+void destroy_sound_bank(void) {
+    for (int e = 0; e < SND_COUNT; ++e) {
+        free(sound_bank[e].data);
+        sound_bank[e] = (SoundClip){NULL, 0};
+    }
+}
+
+void audio_report(void) {
+    if (!audio.device) return;
+    printf("audio: %d commands dropped (queue full), %d dropped and %d stolen (voices of %d busy), "
+           "%d delayed beeps dropped (%d pending max), %d sounds coalesced\n",
+           SDL_AtomicGet(&sound_queue.dropped), SDL_AtomicGet(&sound_queue.no_voice),
+           SDL_AtomicGet(&sound_queue.stolen), sample_capacity, pending_dropped, pending_capacity, sounds_coalesced);
+    SDL_LockAudioDevice(audio.device);
+    printf("audio: %d-frame buffer (%.1f ms), latency avg %.1f ms, max %.1f ms over %d sounds, "
+           "%d underruns in %llu callbacks, %d late starts\n",
+           audio.buffer, audio.buffer * 1000.0 / audio.freq,
+           audio.latency_count ? audio.latency_sum / audio.latency_count : 0.0, audio.latency_max,
+           audio.latency_count, audio.underruns, (unsigned long long)audio.callbacks, audio.late);
+    SDL_UnlockAudioDevice(audio.device);
+}
+
+/* Buffer size to ask the device for: a power of two within range. */
+int audio_buffer_frames(int requested) {
+    int frames = AUDIO_BUFFER_MIN;
+    while (frames < requested && frames < AUDIO_BUFFER_MAX) frames *= 2;
+    return frames;
+}
+
+size_t audio_pools_footprint(const Limits *l) {
+    return arena_round(sizeof(SampleVoice) * (size_t)l->voices) +
+           arena_round(sizeof(ActiveSound) * (size_t)l->voices) +
+           arena_round(sizeof(ScheduledBeep) * (size_t)l->pending_sounds);
+}
+
+/* Clip and synth voices and the delayed-beep list; must happen before the
+ * device is opened. */
+int audio_pools_init(Arena *a, const Limits *l) {
+    sample_voices = arena_alloc(a, sizeof(SampleVoice) * (size_t)l->voices);
+    sounds = arena_alloc(a, sizeof(ActiveSound) * (size_t)l->voices);
+    pending_sounds = arena_alloc(a, sizeof(ScheduledBeep) * (size_t)l->pending_sounds);
+    if (!sample_voices || !sounds || !pending_sounds) return 0;
+    sample_capacity = l->voices;
+    sound_capacity = l->voices;
+    pending_capacity = l->pending_sounds;
+    pending_count = 0;
+    return 1;
+}
+
+static Uint64 ms_to_counter(int ms) {
+    return (Uint64)ms * SDL_GetPerformanceFrequency() / 1000;
+}
+
+/* Queues a beep delay_ms after perf counter time `base`. */
+void schedule_beep(double freq, int dur_ms, Waveform wave, ADSR env, int delay_ms, int priority, Uint64 base) {
+    if (pending_count >= pending_capacity) {
+        pending_dropped++;
+        return;
+    }
+    Uint64 when = base + ms_to_counter(delay_ms);
+    pending_sounds[pending_count++] = (ScheduledBeep){{freq, dur_ms, wave, env, delay_ms}, when, priority};
+}
+
+/* Hands the audio thread every beep falling due before the next update, dt_ms
+ * after the update due at `now`. Each keeps its timestamp, so the mixer
+ * starts it on the exact sample however the updates are timed. */
+void update_sounds(Uint64 now, int dt_ms) {
+    Uint64 horizon = now + ms_to_counter(dt_ms);
+    for (int i = 0; i < pending_count; ) {
+        const ScheduledBeep *p = &pending_sounds[i];
+        if (p->when <= horizon) {
+            play_beep(p->beep.freq, p->beep.dur_ms, p->beep.wave, p->beep.env, p->when, p->priority);
+            pending_sounds[i] = pending_sounds[--pending_count];
+        } else {
+            ++i;
+        }
+    }
+}
+
+/* Starts `count` occurrences of e as one voice at perf counter time `now`,
+ * a little louder for each extra one. Live synthesis (a clip that failed to
+ * render) plays them at unit gain. */
+void enqueue_sound(SoundEvent e, int count, Uint64 now) {
+    if (!audio.device || count <= 0) return;
+    sounds_coalesced += count - 1;
+    if (sound_bank[e].data) {
+        float gain = 1.0f + SOUND_COALESCE_STEP * (float)(count - 1);
+        play_sample(e, gain < SOUND_COALESCE_MAX_GAIN ? gain : SOUND_COALESCE_MAX_GAIN, now);
+        return;
+    }
+    for (size_t i = 0; i < sizeof(sfx_defs) / sizeof(sfx_defs[0]); ++i) {
+        const PendingSound *l = &sfx_defs[i].layer;
+        if (sfx_defs[i].event != e) continue;
+        if (l->delay_ms > 0) {
+            schedule_beep(l->freq, l->dur_ms, l->wave, l->env, l->delay_ms, sound_priority[e], now);
+        } else {
+            play_beep(l->freq, l->dur_ms, l->wave, l->env, now, sound_priority[e]);
+        }
+    }
+}
+
+/* -------------------- Random -------------------- */
+
+/* xorshift64* generators. game_rng drives anything that affects gameplay and
+ * is only ever advanced by the simulation, so a seed plus the per-tick input
+ * reproduces a run exactly. fx_rng covers cosmetic effects (particles,
+ * shake) and may be consumed freely. */
+typedef struct {
+    Uint64 s;
+} Rng;
+
+void rng_seed(Rng *r, Uint64 seed) {
+    /* splitmix64 so that nearby seeds give unrelated streams */
+    Uint64 z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    r->s = z ? z : 1;
+}
+
+static inline Uint32 rng_next(Rng *r) {
+    r->s ^= r->s >> 12;
+    r->s ^= r->s << 25;
+    r->s ^= r->s >> 27;
+    return (Uint32)((r->s * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+/* Uniform-ish integer in [0, n). */
+static inline int rng_range(Rng *r, int n) {
+    return (int)(((Uint64)rng_next(r) * (Uint64)n) >> 32);
+}
+
+/* Float in [0, 1). */
+static inline float rng_unit(Rng *r) {
+    return (float)(rng_next(r) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* -------------------- Game State -------------------- */
+
+/* Gameplay events raised during a tick. The simulation only queues them;
+ * game_events_flush hands them to their consumers once at the end of the
+ * tick, so a volley that kills five aliens makes one kill sound rather than
+ * five. The queue is empty between ticks. */
+typedef enum {
+    EVENT_PLAYER_SHOT,
+    EVENT_ALIEN_SHOT,
+    EVENT_ALIEN_KILLED,
+    EVENT_PLAYER_HIT,
+    EVENT_WAVE_CLEAR,
+    EVENT_COUNT
+} GameEventType;
+
+#define GAME_EVENTS_MAX 64   /* a tick raises a handful: player fire is capped at 3 bullets */
+
+typedef struct {
+    Uint8 type[GAME_EVENTS_MAX];
+    int count;
+} GameEvents;
+
+/* Bullets refused because their pool was full; reported at exit so the
+ * limits can be sized. Particle drops are counted in those. */
+typedef struct {
+    int player_bullets;
+    int alien_bullets;
+} PoolOverflow;
+
+/* One complete game. Everything the simulation reads or writes lives here,
+ * so any number of independent games can run side by side (see the batch
+ * runner); the windowed and headless modes drive the single `game`. */
+typedef struct {
+    SDL_Rect ship;
+    float ship_fx;
+    float ship_prev_fx;        /* at the start of the tick, for interpolation */
+    SDL_Rect *player_bullets;
+    SDL_Rect *alien_bullets;
+    int player_bullet_count;
+    int alien_bullet_count;
+    int bullet_capacity;       /* per side */
+    int score;
+    int lives;
+    int wave;
+    float alien_base_speed;
+    int alien_fire_interval;
+    int alien_fire_timer;
+    int invuln_timer;
+    int wave_clear_timer;
+    int active;
+    Uint32 tick;
+    int shake_timer;
+    int shake_x, shake_y;
+    int muzzle_timer;
+    AlienStore formation;
+    ParticlePool particles;
+    Rng rng;                   /* gameplay; advanced only by the simulation */
+    Rng fx_rng;                /* cosmetic effects (particles, shake) */
+    GameEvents events;         /* raised this tick */
+    int audible;               /* plays sound effects through the mixer */
+    Uint64 tick_time;          /* perf counter time the tick fell due; 0 = now */
+    PoolOverflow overflow;
+} Game;
+
+static Game game;
+
+/* -------------------- Game Helpers -------------------- */
+
+static inline void game_event(Game *g, GameEventType type) {
+    GameEvents *q = &g->events;
+    if (q->count < GAME_EVENTS_MAX) q->type[q->count++] = (Uint8)type;
+}
+
+static const SoundEvent event_sounds[EVENT_COUNT] = {
+    [EVENT_PLAYER_SHOT] = SND_PLAYER_SHOT,
+    [EVENT_ALIEN_SHOT] = SND_ALIEN_SHOT,
+    [EVENT_ALIEN_KILLED] = SND_ALIEN_HIT,
+    [EVENT_PLAYER_HIT] = SND_PLAYER_HIT,
+    [EVENT_WAVE_CLEAR] = SND_WAVE_CLEAR,
+};
+
+/* When the current tick's sounds start: the time it fell due, so ticks run
+ * back to back to catch up still sound a tick apart. */
+static inline Uint64 game_sound_time(const Game *g) {
+    return g->tick_time ? g->tick_time : SDL_GetPerformanceCounter();
+}
+
+/* End of tick: identical events coalesce into one sound each. Sound comes
+ * only from the game that owns the mixer; batch games run silent. */
+void game_events_flush(Game *g) {
+    GameEvents *q = &g->events;
+    if (q->count == 0) return;
+    if (g->audible) {
+        Uint64 when = game_sound_time(g);
+        int counts[EVENT_COUNT] = {0};
+        for (int i = 0; i < q->count; ++i) counts[q->type[i]]++;
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            if (counts[e] > 0) enqueue_sound(event_sounds[e], counts[e], when);
+        }
+    }
+    q->count = 0;
+}
+
+static inline int alien_is_alive(const AlienStore *f, int i) {
+    return (int)((f->alive[i >> 6] >> (i & 63)) & 1u);
+}
+
+int alien_alive_count(const AlienStore *f) {
+    int n = 0;
+    for (int w = 0; w < ALIEN_WORDS(f->count); ++w) n += __builtin_popcountll(f->alive[w]);
+    return n;
+}
+
+SDL_Rect alien_rect(const AlienStore *f, int i) {
+    return (SDL_Rect){(int)(f->origin_x + f->col_x[i % f->cols]),
+                      f->origin_y + (int)f->row_y[i / f->cols], ALIEN_WIDTH, ALIEN_HEIGHT};
+}
+
+/* All of a store's arrays come from one block; the 64-bit words go first so
+ * everything after them stays aligned. */
+static size_t alien_store_bytes(int rows, int cols) {
+    size_t n = (size_t)rows * (size_t)cols;
+    return sizeof(uint64_t) * ALIEN_WORDS(n) + sizeof(float) * ((size_t)rows + (size_t)cols) +
+           sizeof(Uint32) * n + sizeof(int) * ((size_t)rows + (size_t)cols * 3);
+}
+
+size_t alien_store_footprint(int rows, int cols) {
+    return arena_round(alien_store_bytes(rows, cols));
+}
+
+/* Points the store's arrays into p, which holds alien_store_bytes of them. */
+static void alien_store_bind(AlienStore *f, Uint8 *p) {
+    int n = f->rows * f->cols;
+    f->alive = (uint64_t *)p;
+    f->col_x = (float *)(f->alive + ALIEN_WORDS(n));
+    f->row_y = f->col_x + f->cols;
+    f->flash_until = (Uint32 *)(f->row_y + f->rows);
+    f->row_alive = (int *)(f->flash_until + n);
+    f->col_alive = f->row_alive + f->rows;
+    f->col_bottom = f->col_alive + f->cols;
+    f->live_cols = f->col_bottom + f->cols;
+}
+
+int alien_store_init(AlienStore *f, Arena *a, int rows, int cols) {
+    memset(f, 0, sizeof(*f));
+    Uint8 *p = arena_alloc(a, alien_store_bytes(rows, cols));
+    if (!p) return 0;
+    f->rows = rows;
+    f->cols = cols;
+    f->count = rows * cols;
+    alien_store_bind(f, p);
+    return 1;
+}
+
+/* Copies the whole formation into dst, which must have the same shape. */
+void alien_store_copy(AlienStore *dst, const AlienStore *src) {
+    AlienStore arrays = *dst;
+    memcpy(dst->alive, src->alive, alien_store_bytes(src->rows, src->cols));
+    *dst = *src;
+    dst->alive = arrays.alive;
+    dst->col_x = arrays.col_x;
+    dst->row_y = arrays.row_y;
+    dst->flash_until = arrays.flash_until;
+    dst->row_alive = arrays.row_alive;
+    dst->col_alive = arrays.col_alive;
+    dst->col_bottom = arrays.col_bottom;
+    dst->live_cols = arrays.live_cols;
+}
+
+void alien_store_reset(AlienStore *f) {
+    int rows = f->rows, cols = f->cols;
+    memset(f->alive, 0, alien_store_bytes(rows, cols));
+    /* Formations too wide for the usual margin are centred instead. */
+    int width = cols * ALIEN_PITCH_X - ALIEN_H_SPACING;
+    f->origin_x = f->prev_origin_x = FORMATION_X0 + width <= WIDTH ? FORMATION_X0 : (WIDTH - width) / 2;
+    f->origin_y = FORMATION_Y0;
+    f->direction = 1;
+    for (int r = 0; r < rows; ++r) {
+        f->row_y[r] = (float)(r * ALIEN_PITCH_Y);
+        for (int c = 0; c < cols; ++c) {
+            int idx = r * cols + c;
+            f->alive[idx >> 6] |= (uint64_t)1 << (idx & 63);
+        }
+        f->row_alive[r] = cols;
+    }
+    for (int c = 0; c < cols; ++c) {
+        f->col_x[c] = (float)(c * ALIEN_PITCH_X);
+        f->col_alive[c] = rows;
+        f->col_bottom[c] = (rows - 1) * cols + c;
+        f->live_cols[c] = c;
+    }
+    f->live_col_count = cols;
+    f->left_col = 0;
+    f->right_col = cols - 1;
+}
+
+void alien_kill(AlienStore *f, int i, Uint32 tick) {
+    int row = i / f->cols, col = i % f->cols;
+    f->alive[i >> 6] &= ~((uint64_t)1 << (i & 63));
+    f->flash_until[i] = tick + ALIEN_FLASH_TICKS;
+    f->row_alive[row]--;
+    if (--f->col_alive[col] == 0) {
+        f->col_bottom[col] = -1;
+        for (int k = 0; k < f->live_col_count; ++k) {
+            if (f->live_cols[k] == col) {
+                f->live_cols[k] = f->live_cols[--f->live_col_count];
+                break;
             }
-            sample += val * amp;
-            as->phase += 2.0 * M_PI * as->freq / audio.freq;
-            as->t += 1.0 / audio.freq;
         }
-        if (sample > 1.0) sample = 1.0;
-        if (sample < -1.0) sample = -1.0;
-        buffer[i] = (Sint16)(sample * 3000);
+        while (f->left_col < f->cols && f->col_alive[f->left_col] == 0) f->left_col++;
+        while (f->right_col >= 0 && f->col_alive[f->right_col] == 0) f->right_col--;
+    } else if (f->col_bottom[col] == i) {
+        int r = row - 1;
+        while (!alien_is_alive(f, r * f->cols + col)) r--;
+        f->col_bottom[col] = r * f->cols + col;
+    }
+}
+
+/* Moves the formation sideways; on touching a screen edge it stays put,
+ * steps down and reverses instead. */
+void formation_step(AlienStore *f, float move) {
+    if (f->live_col_count == 0) return;
+    float nx = f->origin_x + f->direction * move;
+    int left = (int)(nx + f->col_x[f->left_col]);
+    int right = (int)(nx + f->col_x[f->right_col]) + ALIEN_WIDTH;
+    if (left < 0 || right > WIDTH) {
+        f->origin_y += ALIEN_STEP_DOWN;
+        f->direction *= -1;
+    } else {
+        f->origin_x = nx;
+    }
+}
+
+void init_wave(Game *g, int wave_number) {
+    g->player_bullet_count = 0;
+    g->alien_bullet_count = 0;
+    alien_store_reset(&g->formation);
+    g->alien_base_speed = ALIEN_SPEED * powf(1.1f, wave_number - 1);
+    if (g->alien_base_speed > ALIEN_MAX_SPEED) g->alien_base_speed = ALIEN_MAX_SPEED;
+    g->alien_fire_interval = (int)(1500 / powf(1.1f, wave_number - 1));
+    if (g->alien_fire_interval < 400) g->alien_fire_interval = 400;
+    g->alien_fire_timer = g->alien_fire_interval;
+    g->particles.count = 0;
+    g->muzzle_timer = 0;
+    g->shake_timer = 0;
+}
+
+void spawn_alien_bullet(Game *g, SDL_Rect from) {
+    if (g->alien_bullet_count >= g->bullet_capacity) {
+        g->overflow.alien_bullets++;
+        return;
+    }
+    g->alien_bullets[g->alien_bullet_count++] =
+        (SDL_Rect){from.x + from.w / 2 - BULLET_WIDTH / 2, from.y + from.h, BULLET_WIDTH, BULLET_HEIGHT};
+    game_event(g, EVENT_ALIEN_SHOT);
+}
+
+#define PARTICLE_LIFETIME 300   /* ms */
+
+size_t particles_footprint(int capacity) {
+    return arena_round(sizeof(float) * (size_t)capacity * 5);
+}
+
+int particles_init(ParticlePool *p, Arena *a, int capacity) {
+    memset(p, 0, sizeof(*p));
+    p->x = arena_alloc(a, sizeof(float) * (size_t)capacity * 5);
+    if (!p->x) return 0;
+    p->y = p->x + capacity;
+    p->vx = p->y + capacity;
+    p->vy = p->vx + capacity;
+    p->life = p->vy + capacity;
+    p->capacity = capacity;
+    return 1;
+}
+
+void spawn_particles(ParticlePool *p, Rng *rng, int x, int y) {
+    int n = 12 + rng_range(rng, 9);
+    if (n > p->capacity - p->count) p->dropped += n - (p->capacity - p->count);
+    for (int i = 0; i < n && p->count < p->capacity; ++i) {
+        float angle = rng_unit(rng) * 2.0f * (float)M_PI;
+        float speed = 50.0f + rng_range(rng, 100); /* px per second */
+        int j = p->count++;
+        p->life[j] = PARTICLE_LIFETIME;
+        p->x[j] = (float)x;
+        p->y[j] = (float)y;
+        p->vx[j] = cosf(angle) * speed;
+        p->vy[j] = sinf(angle) * speed;
+    }
+}
+
+static void particle_kill(ParticlePool *p, int i) {
+    int last = --p->count;
+    p->x[i] = p->x[last];
+    p->y[i] = p->y[last];
+    p->vx[i] = p->vx[last];
+    p->vy[i] = p->vy[last];
+    p->life[i] = p->life[last];
+}
+
+void update_particles(ParticlePool *p, int dt) {
+    int n = p->count;
+    float step = dt / 1000.0f;
+    float *restrict x = p->x, *restrict y = p->y, *restrict life = p->life;
+    const float *restrict vx = p->vx, *restrict vy = p->vy;
+    for (int i = 0; i < n; ++i) {
+        x[i] += vx[i] * step;
+        y[i] += vy[i] * step;
+        life[i] -= (float)dt;
+    }
+    for (int i = 0; i < p->count;) {
+        if (p->life[i] <= 0.0f) {
+            particle_kill(p, i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+/* Quads for every live particle go out in one SDL_RenderGeometry call, with
+ * the fade carried in the vertex alpha. */
+static SDL_Vertex *particle_verts = NULL;
+static int *particle_indices = NULL;
+
+size_t particle_geometry_footprint(int capacity) {
+    return arena_round(sizeof(SDL_Vertex) * (size_t)capacity * 4) + arena_round(sizeof(int) * (size_t)capacity * 6);
+}
+
+int particle_geometry_init(Arena *a, int capacity) {
+    particle_verts = arena_alloc(a, sizeof(SDL_Vertex) * (size_t)capacity * 4);
+    particle_indices = arena_alloc(a, sizeof(int) * (size_t)capacity * 6);
+    if (!particle_verts || !particle_indices) return 0;
+    for (int i = 0; i < capacity; ++i) {
+        int v = i * 4;
+        int *idx = &particle_indices[i * 6];
+        idx[0] = v; idx[1] = v + 1; idx[2] = v + 2;
+        idx[3] = v + 2; idx[4] = v + 3; idx[5] = v;
+    }
+    return 1;
+}
+
+void particle_geometry_free(void) {
+    particle_verts = NULL;
+    particle_indices = NULL;
+}
+
+void draw_particles(SDL_Renderer *renderer, const ParticlePool *p, float frame_alpha, int shake_x, int shake_y) {
+    float lag = (1.0f - frame_alpha) * SIM_DT_MS / 1000.0f;
+    float ox = (float)shake_x, oy = (float)shake_y;
+    if (p->count == 0) return;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    if (particle_verts && !softfb.enabled) {
+        for (int i = 0; i < p->count; ++i) {
+            float px = (float)(int)(p->x[i] - p->vx[i] * lag) + ox;
+            float py = (float)(int)(p->y[i] - p->vy[i] * lag) + oy;
+            SDL_Color c = {COLOR_ALIEN.r, COLOR_ALIEN.g, COLOR_ALIEN.b,
+                           (Uint8)(255.0f * p->life[i] / PARTICLE_LIFETIME)};
+            SDL_Vertex *v = &particle_verts[i * 4];
+            v[0] = (SDL_Vertex){{px, py}, c, {0, 0}};
+            v[1] = (SDL_Vertex){{px + 2, py}, c, {0, 0}};
+            v[2] = (SDL_Vertex){{px + 2, py + 2}, c, {0, 0}};
+            v[3] = (SDL_Vertex){{px, py + 2}, c, {0, 0}};
+        }
+        render_geometry(renderer, particle_verts, p->count * 4, particle_indices, p->count * 6);
+        return;
+    }
+#endif
+    for (int i = 0; i < p->count; ++i) {
+        Uint8 alpha = (Uint8)(255.0f * p->life[i] / PARTICLE_LIFETIME);
+        render_set_color(renderer, COLOR_ALIEN.r, COLOR_ALIEN.g, COLOR_ALIEN.b, alpha);
+        SDL_Rect r = {(int)(p->x[i] - p->vx[i] * lag) + shake_x, (int)(p->y[i] - p->vy[i] * lag) + shake_y, 2, 2};
+        render_fill_rect(renderer, &r);
+    }
+}
+
+/* -------------------- Collision -------------------- */
+
+/* Broad phase for the formation: a rect maps straight to the few grid cells
+ * it can overlap, which are then tested exactly. A one-pixel margin covers
+ * rounding of the float origin. */
+static int floor_div(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+int formation_hit(const AlienStore *f, const SDL_Rect *r) {
+    int ox = (int)f->origin_x;
+    int oy = f->origin_y;
+    int c_lo = floor_div(r->x - 1 - ox - (ALIEN_WIDTH - 1), ALIEN_PITCH_X);
+    int c_hi = floor_div(r->x + r->w - 1 + 1 - ox, ALIEN_PITCH_X);
+    int r_lo = floor_div(r->y - oy - (ALIEN_HEIGHT - 1), ALIEN_PITCH_Y);
+    int r_hi = floor_div(r->y + r->h - 1 - oy, ALIEN_PITCH_Y);
+    if (c_lo < 0) c_lo = 0;
+    if (r_lo < 0) r_lo = 0;
+    if (c_hi >= f->cols) c_hi = f->cols - 1;
+    if (r_hi >= f->rows) r_hi = f->rows - 1;
+    for (int row = r_lo; row <= r_hi; ++row) {
+        if (!f->row_alive[row]) continue;
+        for (int col = c_lo; col <= c_hi; ++col) {
+            int a = row * f->cols + col;
+            if (!alien_is_alive(f, a)) continue;
+            SDL_Rect ar = alien_rect(f, a);
+            if (SDL_HasIntersection(r, &ar)) return a;
+        }
+    }
+    return -1;
+}
+
+void check_collisions(Game *g) {
+    for (int i = 0; i < g->player_bullet_count;) {
+        g->player_bullets[i].y -= BULLET_SPEED;
+        int hit = formation_hit(&g->formation, &g->player_bullets[i]);
+        if (hit != -1) {
+            SDL_Rect a = alien_rect(&g->formation, hit);
+            alien_kill(&g->formation, hit, g->tick);
+            spawn_particles(&g->particles, &g->fx_rng, a.x + a.w / 2, a.y + a.h / 2);
+            g->shake_timer = SHAKE_DURATION;
+            g->score += 10;
+            g->player_bullets[i] = g->player_bullets[--g->player_bullet_count];
+            game_event(g, EVENT_ALIEN_KILLED);
+            continue;
+        }
+        if (g->player_bullets[i].y + g->player_bullets[i].h < 0) {
+            g->player_bullets[i] = g->player_bullets[--g->player_bullet_count];
+        } else {
+            ++i;
+        }
+    }
+
+    for (int i = 0; i < g->alien_bullet_count;) {
+        g->alien_bullets[i].y += BULLET_SPEED;
+        if (g->alien_bullets[i].y > HEIGHT) {
+            g->alien_bullets[i] = g->alien_bullets[--g->alien_bullet_count];
+            continue;
+        }
+        ++i;
+    }
+
+    /* One query against the ship: a straight scan beats building any index. */
+    for (int i = 0; g->invuln_timer <= 0 && i < g->alien_bullet_count; ++i) {
+        if (SDL_HasIntersection(&g->ship, &g->alien_bullets[i])) {
+            g->alien_bullets[i] = g->alien_bullets[--g->alien_bullet_count];
+            g->lives--;
+            g->invuln_timer = 1000;
+            game_event(g, EVENT_PLAYER_HIT);
+            if (g->lives <= 0) g->active = 0;
+        }
+    }
+
+    /* Only the lowest row with a live alien can reach the ship. */
+    for (int r = g->formation.rows - 1; r >= 0; --r) {
+        if (!g->formation.row_alive[r]) continue;
+        if (g->formation.origin_y + r * ALIEN_PITCH_Y + ALIEN_HEIGHT >= g->ship.y) g->active = 0;
+        break;
+    }
+}
+
+int count_active_player_bullets(const Game *g) {
+    int count = 0;
+    for (int i = 0; i < g->player_bullet_count; ++i) {
+        if (g->player_bullets[i].y + g->player_bullets[i].h >= 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+enum { HUD_SCORE, HUD_LIVES, HUD_WAVE, HUD_BANNER, HUD_LABEL_COUNT };
+static TextLabel hud_labels[HUD_LABEL_COUNT];
+
+/* Score line plus the game-over banner, offset by (ox, oy). */
+void draw_hud(SDL_Renderer *renderer, const Snapshot *s, int ox, int oy) {
+    render_set_color(renderer, COLOR_HUD.r, COLOR_HUD.g, COLOR_HUD.b, COLOR_HUD.a);
+    int scale = 2;
+    int y = 10 + oy;
+    draw_label(renderer, &hud_labels[HUD_SCORE], 10 + ox, y, scale, "SCORE:", s->score);
+    draw_label(renderer, &hud_labels[HUD_LIVES], 250 + ox, y, scale, "LIVES:", s->lives);
+    draw_label(renderer, &hud_labels[HUD_WAVE], 450 + ox, y, scale, "WAVE:", s->wave);
+
+    if (!s->active) {
+        const char *msg = "GAME OVER - Press R to restart";
+        int w = text_width_block(msg, 2);
+        int x = (WIDTH - w) / 2 + ox;
+        y = HEIGHT / 2 - (7 * 2) / 2 + oy;
+        render_set_color(renderer, COLOR_HUD.r, COLOR_HUD.g, COLOR_HUD.b, 255);
+        draw_label(renderer, &hud_labels[HUD_BANNER], x, y, 2, msg, LABEL_NO_VALUE);
+    }
+}
+
+void invalidate_hud(void) {
+    for (int i = 0; i < HUD_LABEL_COUNT; ++i) invalidate_label(&hud_labels[i]);
+}
+
+void destroy_hud(void) {
+    for (int i = 0; i < HUD_LABEL_COUNT; ++i) destroy_label(&hud_labels[i]);
+}
+
+void reset_game(Game *g) {
+    g->ship = (SDL_Rect){(WIDTH - SHIP_WIDTH) / 2, HEIGHT - SHIP_HEIGHT - 10, SHIP_WIDTH, SHIP_HEIGHT};
+    g->ship_fx = g->ship_prev_fx = (float)g->ship.x;
+    g->score = 0;
+    g->lives = 3;
+    g->wave = 1;
+    g->invuln_timer = 0;
+    g->active = 1;
+    init_wave(g, 1);
+}
+
+size_t game_footprint(const Limits *l) {
+    size_t bullets = (size_t)l->bullets;
+    return alien_store_footprint(l->alien_rows, l->alien_cols) +
+           arena_round(sizeof(SDL_Rect) * bullets * 2) +
+           particles_footprint(l->particles);
+}
+
+/* Carves a game's pools out of the arena and puts it in its starting state.
+ * The generators get fixed default seeds; reseed them for a fresh run. */
+int game_init(Game *g, Arena *a, const Limits *l) {
+    memset(g, 0, sizeof(*g));
+    if (!alien_store_init(&g->formation, a, l->alien_rows, l->alien_cols)) return 0;
+    g->player_bullets = arena_alloc(a, sizeof(SDL_Rect) * (size_t)l->bullets * 2);
+    if (!g->player_bullets) return 0;
+    g->alien_bullets = g->player_bullets + l->bullets;
+    g->bullet_capacity = l->bullets;
+    if (!particles_init(&g->particles, a, l->particles)) return 0;
+    g->rng.s = 0x853C49E6748FEA9Bull;
+    g->fx_rng.s = 0xDA3E39CB94B95BDBull;
+    g->wave_clear_timer = -1;
+    reset_game(g);
+    return 1;
+}
+
+/* One line per run: each pool's size and how often it overflowed. Batch
+ * runs pass totals over all their games. */
+void pool_report(const Limits *l, const PoolOverflow *o, int particles_dropped) {
+    printf("pools: formation %dx%d, bullets %d (%d player / %d alien refused), "
+           "particles %d (%d dropped)\n",
+           l->alien_rows, l->alien_cols, l->bullets, o->player_bullets, o->alien_bullets,
+           l->particles, particles_dropped);
+}
+
+/* Seeds a game's generators from its run seed. */
+void game_seed(Game *g, Uint64 seed) {
+    rng_seed(&g->rng, seed);
+    rng_seed(&g->fx_rng, seed ^ 0xF00DF00DF00DF00Dull);
+}
+
+/* -------------------- Simulation -------------------- */
+
+/* Player input for one update, decoupled from where it came from (keyboard
+ * or the headless autopilot). fire/restart are edge-triggered. */
+typedef struct {
+    int left;
+    int right;
+    int fire;
+    int restart;
+    int rewind;     /* held: step back through the rewind history instead */
+} Input;
+
+void fire_player_bullet(Game *g) {
+    if (count_active_player_bullets(g) >= 3) return;
+    if (g->player_bullet_count >= g->bullet_capacity) {
+        g->overflow.player_bullets++;
+        return;
+    }
+    g->player_bullets[g->player_bullet_count++] =
+        (SDL_Rect){g->ship.x + SHIP_WIDTH / 2 - BULLET_WIDTH / 2,
+                   g->ship.y - BULLET_HEIGHT, BULLET_WIDTH, BULLET_HEIGHT};
+    g->muzzle_timer = 50;
+    game_event(g, EVENT_PLAYER_SHOT);
+}
+
+void update_game(Game *g, const Input *in, int dt) {
+    if (in->fire && g->active) fire_player_bullet(g);
+    if (in->restart && !g->active) reset_game(g);
+
+    Uint64 t = prof_begin();
+    if (g->audible) update_sounds(game_sound_time(g), dt);
+    prof_end(PROF_SOUNDS, t);
+
+    if (g->active) {
+        if (in->left) {
+            g->ship_fx -= SHIP_SPEED;
+            if (g->ship_fx < 0) g->ship_fx = 0;
+        }
+        if (in->right) {
+            g->ship_fx += SHIP_SPEED;
+            if (g->ship_fx > WIDTH - SHIP_WIDTH) g->ship_fx = WIDTH - SHIP_WIDTH;
+        }
+        g->ship.x = (int)g->ship_fx;
+
+        t = prof_begin();
+        int alive_count = alien_alive_count(&g->formation);
+        float speed_multiplier = 1.0f + (g->formation.count - alive_count) * 0.02f;
+        formation_step(&g->formation, g->alien_base_speed * speed_multiplier);
+
+        g->alien_fire_timer -= dt;
+        if (g->alien_fire_timer <= 0) {
+            if (g->formation.live_col_count > 0) {
+                int col = g->formation.live_cols[rng_range(&g->rng, g->formation.live_col_count)];
+                spawn_alien_bullet(g, alien_rect(&g->formation, g->formation.col_bottom[col]));
+            }
+            g->alien_fire_timer = g->alien_fire_interval;
+        }
+        prof_end(PROF_ALIENS, t);
+
+        t = prof_begin();
+        check_collisions(g);
+        prof_end(PROF_COLLISIONS, t);
+
+        if (g->invuln_timer > 0) g->invuln_timer -= dt;
+
+        if (alive_count == 0 && g->wave_clear_timer < 0) {
+            g->wave_clear_timer = 1500;
+            game_event(g, EVENT_WAVE_CLEAR);
+        }
+        if (g->wave_clear_timer >= 0) {
+            g->wave_clear_timer -= dt;
+            if (g->wave_clear_timer <= 0) {
+                g->wave++;
+                init_wave(g, g->wave);
+            }
+        }
+    }
+
+    t = prof_begin();
+    update_particles(&g->particles, dt);
+    prof_end(PROF_PARTICLES, t);
+    if (g->muzzle_timer > 0) g->muzzle_timer -= dt;
+    if (g->shake_timer > 0) g->shake_timer -= dt;
+    if (g->shake_timer > 0) {
+        g->shake_x = rng_range(&g->fx_rng, SHAKE_MAG * 2 + 1) - SHAKE_MAG;
+        g->shake_y = rng_range(&g->fx_rng, SHAKE_MAG * 2 + 1) - SHAKE_MAG;
+    } else {
+        g->shake_x = g->shake_y = 0;
+    }
+    game_events_flush(g);
+    g->tick++;
+}
+
+/* Advances the game by exactly one fixed tick. */
+void sim_tick(Game *g, const Input *in) {
+    g->ship_prev_fx = g->ship_fx;
+    g->formation.prev_origin_x = g->formation.origin_x;
+    update_game(g, in, SIM_DT_MS);
+}
+
+/* Simple bot for headless runs: track the lowest live alien, fire whenever
+ * allowed and restart after game over. */
+void autopilot_input(const Game *g, Input *in) {
+    memset(in, 0, sizeof(*in));
+    if (!g->active) {
+        in->restart = 1;
+        return;
+    }
+    int target = -1;
+    for (int k = 0; k < g->formation.live_col_count; ++k) {
+        int i = g->formation.col_bottom[g->formation.live_cols[k]];
+        int cols = g->formation.cols;
+        if (target < 0 || i / cols > target / cols || (i / cols == target / cols && i > target)) target = i;
+    }
+    if (target >= 0) {
+        SDL_Rect t = alien_rect(&g->formation, target);
+        int cx = g->ship.x + SHIP_WIDTH / 2;
+        int tx = t.x + t.w / 2;
+        in->left = tx < cx - SHIP_SPEED;
+        in->right = tx > cx + SHIP_SPEED;
+    }
+    in->fire = 1;
+}
+
+/* -------------------- Replay -------------------- */
+
+/* Input logs: a header with the game seed and the limits that affect play
+ * (formation rows and columns, bullets per side), then the per-tick input
+ * bytes run-length encoded as (byte, LEB128 run length) pairs, terminated by
+ * REPLAY_END, the tick count and a hash of the final game state so a replay
+ * can verify it reproduced the run bit for bit. Version 1 logs have no
+ * limits and imply the defaults. */
+#define REPLAY_MAGIC "VDRP"
+#define REPLAY_VERSION 2
+#define REPLAY_END 0xFF
+
+enum { INPUT_LEFT = 1, INPUT_RIGHT = 2, INPUT_FIRE = 4, INPUT_RESTART = 8,
+       INPUT_REWIND = 16 /* window only, never recorded */ };
+
+Uint8 input_pack(const Input *in) {
+    return (Uint8)((in->left ? INPUT_LEFT : 0) | (in->right ? INPUT_RIGHT : 0) |
+                   (in->fire ? INPUT_FIRE : 0) | (in->restart ? INPUT_RESTART : 0));
+}
+
+void input_unpack(Uint8 bits, Input *in) {
+    in->left = (bits & INPUT_LEFT) != 0;
+    in->right = (bits & INPUT_RIGHT) != 0;
+    in->fire = (bits & INPUT_FIRE) != 0;
+    in->restart = (bits & INPUT_RESTART) != 0;
+}
+
+typedef struct {
+    FILE *fp;
+    Uint64 seed;
+    int alien_rows, alien_cols, bullets;
+    long ticks;
+    Uint8 run_input;     /* current run (writer) or run being played (reader) */
+    Uint32 run_len;
+    int ended;
+    long end_ticks;
+    Uint32 end_hash;
+    int matched;         /* replay_verify's result, once run_tick ran out of log */
+} Replay;
+
+static Uint32 fnv1a(Uint32 h, const void *data, size_t len) {
+    const Uint8 *p = data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Hash of everything that influences gameplay; cosmetic state is excluded. */
+Uint32 game_state_hash(const Game *g) {
+    Uint32 h = 2166136261u;
+    h = fnv1a(h, &g->ship_fx, sizeof(g->ship_fx));
+    h = fnv1a(h, &g->player_bullet_count, sizeof(int));
+    h = fnv1a(h, g->player_bullets, sizeof(SDL_Rect) * (size_t)g->player_bullet_count);
+    h = fnv1a(h, &g->alien_bullet_count, sizeof(int));
+    h = fnv1a(h, g->alien_bullets, sizeof(SDL_Rect) * (size_t)g->alien_bullet_count);
+    h = fnv1a(h, &g->formation.origin_x, sizeof(g->formation.origin_x));
+    h = fnv1a(h, &g->formation.origin_y, sizeof(g->formation.origin_y));
+    h = fnv1a(h, &g->formation.direction, sizeof(g->formation.direction));
+    h = fnv1a(h, g->formation.alive, sizeof(uint64_t) * ALIEN_WORDS(g->formation.count));
+    int vals[] = {g->score, g->lives, g->wave, g->alien_fire_timer, g->alien_fire_interval,
+                  g->invuln_timer, g->wave_clear_timer, g->active};
+    h = fnv1a(h, vals, sizeof(vals));
+    h = fnv1a(h, &g->rng.s, sizeof(g->rng.s));
+    return h;
+}
+
+static void write_u64(FILE *fp, Uint64 v) {
+    for (int i = 0; i < 8; ++i) fputc((int)((v >> (8 * i)) & 0xFF), fp);
+}
+
+static int read_u64(FILE *fp, Uint64 *out) {
+    Uint64 v = 0;
+    for (int i = 0; i < 8; ++i) {
+        int c = fgetc(fp);
+        if (c == EOF) return 0;
+        v |= (Uint64)c << (8 * i);
+    }
+    *out = v;
+    return 1;
+}
+
+int replay_open_write(Replay *r, const char *path, Uint64 seed, const Limits *l) {
+    memset(r, 0, sizeof(*r));
+    r->fp = fopen(path, "wb");
+    if (!r->fp) {
+        SDL_Log("Failed to open %s for recording", path);
+        return 0;
+    }
+    fwrite(REPLAY_MAGIC, 1, 4, r->fp);
+    fputc(REPLAY_VERSION, r->fp);
+    write_u64(r->fp, seed);
+    write_u64(r->fp, (Uint64)l->alien_rows);
+    write_u64(r->fp, (Uint64)l->alien_cols);
+    write_u64(r->fp, (Uint64)l->bullets);
+    r->seed = seed;
+    return 1;
+}
+
+static void replay_flush_run(Replay *r) {
+    if (r->run_len == 0) return;
+    fputc(r->run_input, r->fp);
+    Uint32 n = r->run_len;
+    do {
+        Uint8 b = n & 0x7F;
+        n >>= 7;
+        fputc(n ? (b | 0x80) : b, r->fp);
+    } while (n);
+    r->run_len = 0;
+}
+
+void replay_write(Replay *r, Uint8 input) {
+    if (r->run_len > 0 && (input != r->run_input || r->run_len == 0xFFFFFFFFu)) replay_flush_run(r);
+    r->run_input = input;
+    r->run_len++;
+    r->ticks++;
+}
+
+void replay_close_write(Replay *r, Uint32 final_hash) {
+    if (!r->fp) return;
+    replay_flush_run(r);
+    fputc(REPLAY_END, r->fp);
+    write_u64(r->fp, (Uint64)r->ticks);
+    write_u64(r->fp, final_hash);
+    fclose(r->fp);
+    r->fp = NULL;
+}
+
+int replay_open_read(Replay *r, const char *path) {
+    char magic[4];
+    memset(r, 0, sizeof(*r));
+    r->fp = fopen(path, "rb");
+    if (!r->fp) {
+        SDL_Log("Failed to open replay %s", path);
+        return 0;
+    }
+    int version = -1;
+    Uint64 rows = ALIEN_ROWS_DEFAULT, cols = ALIEN_COLS_DEFAULT, bullets = BULLETS_DEFAULT;
+    if (fread(magic, 1, 4, r->fp) == 4 && memcmp(magic, REPLAY_MAGIC, 4) == 0) version = fgetc(r->fp);
+    if ((version != 1 && version != REPLAY_VERSION) || !read_u64(r->fp, &r->seed) ||
+        (version >= 2 && (!read_u64(r->fp, &rows) || !read_u64(r->fp, &cols) || !read_u64(r->fp, &bullets)))) {
+        SDL_Log("%s is not a replay file", path);
+        fclose(r->fp);
+        r->fp = NULL;
+        return 0;
+    }
+    r->alien_rows = (int)rows;
+    r->alien_cols = (int)cols;
+    r->bullets = (int)bullets;
+    return 1;
+}
+
+/* Next tick's input; returns 0 once the log is exhausted. */
+int replay_read(Replay *r, Uint8 *input) {
+    if (r->ended) return 0;
+    while (r->run_len == 0) {
+        int c = fgetc(r->fp);
+        Uint64 ticks, hash;
+        if (c == REPLAY_END && read_u64(r->fp, &ticks) && read_u64(r->fp, &hash)) {
+            r->end_ticks = (long)ticks;
+            r->end_hash = (Uint32)hash;
+            r->ended = 1;
+            return 0;
+        }
+        if (c == EOF || c == REPLAY_END) {
+            SDL_Log("Replay log is truncated");
+            r->end_ticks = -1;
+            r->ended = 1;
+            return 0;
+        }
+        r->run_input = (Uint8)c;
+        Uint32 n = 0;
+        int shift = 0, b;
+        do {
+            b = fgetc(r->fp);
+            if (b == EOF) break;
+            n |= (Uint32)(b & 0x7F) << shift;
+            shift += 7;
+        } while ((b & 0x80) && shift < 35);
+        r->run_len = n;
+    }
+    r->run_len--;
+    r->ticks++;
+    *input = r->run_input;
+    return 1;
+}
+
+/* Compares the finished replay against the recorded outcome. */
+int replay_verify(const Replay *r, const Game *g) {
+    if (r->end_ticks < 0) return 0;
+    Uint32 hash = game_state_hash(g);
+    int ok = r->ticks == r->end_ticks && hash == r->end_hash;
+    printf("replay: %ld ticks, state hash %08x, recorded %08x: %s\n",
+           r->ticks, (unsigned)hash, (unsigned)r->end_hash, ok ? "match" : "MISMATCH");
+    return ok;
+}
+
+void replay_close(Replay *r) {
+    if (r->fp) fclose(r->fp);
+    r->fp = NULL;
+}
+
+/* -------------------- Rewind -------------------- */
+
+/* History of the last few seconds of play for stepping backwards. Every tick
+ * the complete game state is flattened into a fixed-size image and stored
+ * XORed against the most recent keyframe, with the runs of unchanged bytes
+ * coded as lengths: literal runs are (zero run, literal run) LEB128 pairs
+ * followed by the changed bytes. A keyframe is the same code against an
+ * all-zero image and is written every REWIND_KEYFRAME_TICKS, so any held
+ * tick decodes from two records. The encoded frames share a byte ring and
+ * the oldest keyframe group is evicted whole when it runs out, so history
+ * is bounded by whichever of the tick count or the byte budget fills first.
+ * Each frame also keeps the input its tick applied, to resimulate forward
+ * from a keyframe. */
+#define REWIND_MAX_SECONDS 600
+#define REWIND_KEYFRAME_TICKS 64
+#define REWIND_BYTES_PER_SECOND (64 * 1024)
+#define REWIND_MIN_ZERO_RUN 4   /* shorter unchanged runs stay in the literal */
+
+typedef struct {
+    Uint32 offset, len;     /* encoded bytes in data */
+    Uint32 key;             /* tick of the keyframe it is a delta against */
+    Uint8 input;            /* packed Input this tick applied */
+} RewindFrame;
+
+typedef struct {
+    size_t state_size;
+    Uint8 *data;            /* byte ring of encoded frames */
+    size_t size;
+    size_t head;            /* where the next frame goes */
+    RewindFrame *frames;    /* indexed by tick % capacity */
+    int capacity;
+    Uint32 first;           /* oldest tick held */
+    int count;
+    int key_valid;
+    Uint32 key_tick;        /* newest keyframe, the reference for new deltas */
+    Uint8 *key_state;
+    int decoded_valid;
+    Uint32 decoded_tick;    /* keyframe currently expanded in decoded */
+    Uint8 *decoded;
+    Uint8 *state;           /* scratch image */
+    Uint8 *zero;            /* reference for keyframes, never written */
+    Uint8 *encoded;         /* scratch for one encoded frame */
+    Uint64 frames_pushed;
+    Uint64 bytes_pushed;
+    int keyframes;
+} Rewind;
+
+/* Bytes in a flattened game: the Game itself with the pool arrays after it.
+ * Pointers are stored but never loaded, so they cost nothing in a delta. */
+static size_t game_state_size(const Limits *l) {
+    return sizeof(Game) + alien_store_bytes(l->alien_rows, l->alien_cols) +
+           sizeof(SDL_Rect) * (size_t)l->bullets * 2 + sizeof(float) * (size_t)l->particles * 5;
+}
+
+/* Dead bullet and particle slots are zeroed so identical games give
+ * identical images; the (empty) event queue and statistics are left
+ * out. */
+void game_state_save(const Game *g, Uint8 *out) {
+    memcpy(out, g, sizeof(Game));
+    Game *img = (Game *)out;
+    memset(&img->overflow, 0, sizeof(img->overflow));
+    memset(&img->events, 0, sizeof(img->events));
+    img->audible = 0;
+    img->tick_time = 0;
+    Uint8 *p = out + sizeof(Game);
+    size_t bytes = alien_store_bytes(g->formation.rows, g->formation.cols);
+    memcpy(p, g->formation.alive, bytes);
+    p += bytes;
+
+    const SDL_Rect *lists[2] = {g->player_bullets, g->alien_bullets};
+    int counts[2] = {g->player_bullet_count, g->alien_bullet_count};
+    for (int i = 0; i < 2; ++i) {
+        memcpy(p, lists[i], sizeof(SDL_Rect) * (size_t)counts[i]);
+        memset(p + sizeof(SDL_Rect) * (size_t)counts[i], 0,
+               sizeof(SDL_Rect) * (size_t)(g->bullet_capacity - counts[i]));
+        p += sizeof(SDL_Rect) * (size_t)g->bullet_capacity;
+    }
+
+    const ParticlePool *pp = &g->particles;
+    const float *arrays[5] = {pp->x, pp->y, pp->vx, pp->vy, pp->life};
+    for (int i = 0; i < 5; ++i) {
+        memcpy(p, arrays[i], sizeof(float) * (size_t)pp->count);
+        memset(p + sizeof(float) * (size_t)pp->count, 0, sizeof(float) * (size_t)(pp->capacity - pp->count));
+        p += sizeof(float) * (size_t)pp->capacity;
+    }
+}
+
+/* Loads an image saved from a game with the same limits. g keeps its own
+ * pools, statistics, mixer ownership and tick clock. */
+void game_state_load(Game *g, const Uint8 *in) {
+    Game keep = *g;
+    memcpy(g, in, sizeof(Game));
+    const Uint8 *p = in + sizeof(Game);
+
+    AlienStore src = g->formation;
+    alien_store_bind(&src, (Uint8 *)p);
+    g->formation = keep.formation;
+    alien_store_copy(&g->formation, &src);
+    p += alien_store_bytes(src.rows, src.cols);
+
+    g->player_bullets = keep.player_bullets;
+    g->alien_bullets = keep.alien_bullets;
+    memcpy(g->player_bullets, p, sizeof(SDL_Rect) * (size_t)keep.bullet_capacity);
+    p += sizeof(SDL_Rect) * (size_t)keep.bullet_capacity;
+    memcpy(g->alien_bullets, p, sizeof(SDL_Rect) * (size_t)keep.bullet_capacity);
+    p += sizeof(SDL_Rect) * (size_t)keep.bullet_capacity;
+
+    int count = g->particles.count;
+    g->particles = keep.particles;
+    g->particles.count = count;
+    memcpy(g->particles.x, p, sizeof(float) * (size_t)keep.particles.capacity * 5);
+
+    g->events = keep.events;
+    g->overflow = keep.overflow;
+    g->audible = keep.audible;
+    g->tick_time = keep.tick_time;
+}
+
+static Uint8 *put_leb128(Uint8 *p, size_t n) {
+    do {
+        Uint8 b = n & 0x7F;
+        n >>= 7;
+        *p++ = n ? (b | 0x80) : b;
+    } while (n);
+    return p;
+}
+
+static const Uint8 *get_leb128(const Uint8 *p, size_t *out) {
+    size_t n = 0;
+    int shift = 0;
+    Uint8 b;
+    do {
+        b = *p++;
+        n |= (size_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    *out = n;
+    return p;
+}
+
+/* Worst case: every literal is split by a minimum zero run. */
+static size_t rewind_encode_bound(size_t n) {
+    return n + 2 * 10 * (n / (REWIND_MIN_ZERO_RUN + 1) + 1);
+}
+
+/* Codes cur XOR ref into out; returns the encoded length. */
+size_t rewind_encode(const Uint8 *cur, const Uint8 *ref, size_t n, Uint8 *out) {
+    Uint8 *o = out;
+    size_t i = 0;
+    while (i < n) {
+        size_t z = i;
+        while (z + 8 <= n && memcmp(cur + z, ref + z, 8) == 0) z += 8;
+        while (z < n && cur[z] == ref[z]) ++z;
+        /* The literal ends before the first long enough unchanged run. */
+        size_t end = z;
+        for (size_t j = z; j < n && j - end < REWIND_MIN_ZERO_RUN; ++j) {
+            if (cur[j] != ref[j]) end = j + 1;
+        }
+        o = put_leb128(o, z - i);
+        o = put_leb128(o, end - z);
+        for (size_t j = z; j < end; ++j) *o++ = cur[j] ^ ref[j];
+        i = end;
+    }
+    return (size_t)(o - out);
+}
+
+/* XORs a coded delta into state, which must hold its reference. */
+void rewind_apply(Uint8 *state, const Uint8 *code, size_t len) {
+    const Uint8 *p = code, *end = code + len;
+    size_t at = 0;
+    while (p < end) {
+        size_t zeros, literal;
+        p = get_leb128(p, &zeros);
+        p = get_leb128(p, &literal);
+        at += zeros;
+        for (size_t j = 0; j < literal; ++j) state[at + j] ^= p[j];
+        p += literal;
+        at += literal;
+    }
+}
+
+static int rewind_ticks(int seconds) {
+    return seconds * SIM_HZ;
+}
+
+static size_t rewind_data_size(const Limits *l, int seconds) {
+    size_t budget = (size_t)seconds * REWIND_BYTES_PER_SECOND;
+    size_t floor = rewind_encode_bound(game_state_size(l)) * 4;   /* a few keyframes, whatever the limits */
+    return budget > floor ? budget : floor;
+}
+
+size_t rewind_footprint(const Limits *l, int seconds) {
+    if (seconds <= 0) return 0;
+    size_t state = game_state_size(l);
+    return arena_round(rewind_data_size(l, seconds)) + arena_round(sizeof(RewindFrame) * (size_t)rewind_ticks(seconds)) +
+           arena_round(state) * 4 + arena_round(rewind_encode_bound(state));
+}
+
+/* Leaves the buffer disabled (frames NULL) for seconds <= 0. */
+int rewind_init(Rewind *r, Arena *a, const Limits *l, int seconds) {
+    memset(r, 0, sizeof(*r));
+    if (seconds <= 0) return 1;
+    r->state_size = game_state_size(l);
+    r->size = rewind_data_size(l, seconds);
+    r->capacity = rewind_ticks(seconds);
+    r->data = arena_alloc(a, r->size);
+    r->frames = arena_alloc(a, sizeof(RewindFrame) * (size_t)r->capacity);
+    r->key_state = arena_alloc(a, r->state_size);
+    r->decoded = arena_alloc(a, r->state_size);
+    r->state = arena_alloc(a, r->state_size);
+    r->zero = arena_alloc(a, r->state_size);
+    r->encoded = arena_alloc(a, rewind_encode_bound(r->state_size));
+    if (!r->data || !r->frames || !r->key_state || !r->decoded || !r->state || !r->zero || !r->encoded) {
+        r->frames = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+static inline RewindFrame *rewind_frame(const Rewind *r, Uint32 tick) {
+    return &r->frames[tick % (Uint32)r->capacity];
+}
+
+int rewind_holds(const Rewind *r, Uint32 tick) {
+    return r->frames && r->count > 0 && tick - r->first < (Uint32)r->count;
+}
+
+static void rewind_clear(Rewind *r, Uint32 first) {
+    r->first = first;
+    r->count = 0;
+    r->head = 0;
+    r->key_valid = 0;
+    r->decoded_valid = 0;
+}
+
+/* Drops the oldest keyframe and the deltas against it. Refuses when that is
+ * the keyframe new deltas are coded against. */
+static int rewind_evict_group(Rewind *r) {
+    Uint32 key = rewind_frame(r, r->first)->key;
+    if (r->key_valid && key == r->key_tick) return 0;
+    if (r->decoded_valid && r->decoded_tick == key) r->decoded_valid = 0;
+    do {
+        r->first++;
+        r->count--;
+    } while (r->count > 0 && rewind_frame(r, r->first)->key == key);
+    return 1;
+}
+
+/* Offset for len more bytes, evicting whatever is in the way, or -1 if that
+ * would take the current keyframe with it. */
+static long rewind_make_room(Rewind *r, size_t len) {
+    size_t at = r->head;
+    if (len > r->size - at) {
+        /* Anything past the head is from the previous lap and older than
+         * everything at the start. */
+        while (r->count > 0 && rewind_frame(r, r->first)->offset >= at) {
+            if (!rewind_evict_group(r)) return -1;
+        }
+        at = 0;
+    }
+    while (r->count > 0) {
+        const RewindFrame *f = rewind_frame(r, r->first);
+        if (f->offset >= at + len || f->offset + f->len <= at) break;
+        if (!rewind_evict_group(r)) return -1;
+    }
+    return (long)at;
+}
+
+/* Records the state at the start of g's current tick and the input that
+ * tick is about to apply. Pushing a tick that is already held, after
+ * rewinding to it, discards it and everything after it first. */
+void rewind_push(Rewind *r, const Game *g, Uint8 input) {
+    if (!r->frames) return;
+    Uint32 tick = g->tick;
+    if (rewind_holds(r, tick)) {
+        r->count = (int)(tick - r->first);
+        if (r->key_valid && (Sint32)(r->key_tick - tick) >= 0) r->key_valid = 0;
+        if (r->decoded_valid && (Sint32)(r->decoded_tick - tick) >= 0) r->decoded_valid = 0;
+        if (r->count > 0) {
+            const RewindFrame *last = rewind_frame(r, tick - 1);
+            r->head = last->offset + last->len;
+        } else {
+            rewind_clear(r, tick);
+        }
+    } else if (r->count == 0 || tick != r->first + (Uint32)r->count) {
+        rewind_clear(r, tick);
+    }
+    if (r->count == r->capacity && !rewind_evict_group(r)) rewind_clear(r, tick);
+
+    game_state_save(g, r->state);
+    int key = !r->key_valid || tick - r->key_tick >= REWIND_KEYFRAME_TICKS;
+    size_t len = rewind_encode(r->state, key ? r->zero : r->key_state, r->state_size, r->encoded);
+    long at = rewind_make_room(r, len);
+    if (at < 0) {
+        /* The byte budget can't hold one keyframe group; start over. */
+        rewind_clear(r, tick);
+        key = 1;
+        len = rewind_encode(r->state, r->zero, r->state_size, r->encoded);
+        at = 0;
+    }
+    if (key) {
+        memcpy(r->key_state, r->state, r->state_size);
+        r->key_tick = tick;
+        r->key_valid = 1;
+        r->keyframes++;
+    }
+    memcpy(r->data + at, r->encoded, len);
+    RewindFrame *f = rewind_frame(r, tick);
+    f->offset = (Uint32)at;
+    f->len = (Uint32)len;
+    f->key = r->key_tick;
+    f->input = input;
+    r->head = (size_t)at + len;
+    r->count++;
+    r->frames_pushed++;
+    r->bytes_pushed += len;
+}
+
+/* Puts g back at the start of a held tick, decoding its delta directly. */
+int rewind_restore(Rewind *r, Game *g, Uint32 tick) {
+    if (!rewind_holds(r, tick)) return 0;
+    const RewindFrame *f = rewind_frame(r, tick);
+    if (!r->decoded_valid || r->decoded_tick != f->key) {
+        const RewindFrame *k = rewind_frame(r, f->key);
+        memset(r->decoded, 0, r->state_size);
+        rewind_apply(r->decoded, r->data + k->offset, k->len);
+        r->decoded_tick = f->key;
+        r->decoded_valid = 1;
+    }
+    memcpy(r->state, r->decoded, r->state_size);
+    if (tick != f->key) rewind_apply(r->state, r->data + f->offset, f->len);
+    game_state_load(g, r->state);
+    return 1;
+}
+
+/* Seeks to the keyframe at or before a held tick and replays the recorded
+ * inputs up to it, silently. Ends in the same state as rewind_restore. */
+int rewind_resimulate(Rewind *r, Game *g, Uint32 tick) {
+    if (!rewind_holds(r, tick)) return 0;
+    Uint32 key = rewind_frame(r, tick)->key;
+    rewind_restore(r, g, key);
+    int audible = g->audible;
+    g->audible = 0;
+    for (Uint32 t = key; t != tick; ++t) {
+        Input in;
+        input_unpack(rewind_frame(r, t)->input, &in);
+        sim_tick(g, &in);
+    }
+    g->audible = audible;
+    return 1;
+}
+
+/* Checks that decoding and resimulating agree on a spread of held ticks,
+ * then puts g back where it was. */
+int rewind_check(Rewind *r, Game *g) {
+    if (!r->frames || r->count < 2) return 1;
+    Uint8 *now = r->key_state;   /* reused: nothing is pushed until g is restored */
+    game_state_save(g, now);
+    int ok = 1;
+    for (int i = 0; i < 8 && ok; ++i) {
+        Uint32 tick = r->first + (Uint32)((Uint64)(r->count - 1) * (Uint64)i / 7);
+        rewind_restore(r, g, tick);
+        Uint32 decoded = game_state_hash(g);
+        rewind_resimulate(r, g, tick);
+        ok = game_state_hash(g) == decoded;
+    }
+    game_state_load(g, now);
+    r->key_valid = 0;
+    r->decoded_valid = 0;
+    return ok;
+}
+
+void rewind_report(const Rewind *r) {
+    if (!r->frames || r->frames_pushed == 0) return;
+    size_t held = 0;
+    for (int i = 0; i < r->count; ++i) held += rewind_frame(r, r->first + (Uint32)i)->len;
+    printf("rewind: %d ticks held (%.1f s of %.1f s), %zu of %zu KB, %.0f bytes/tick against %zu-byte states, "
+           "%d keyframes\n", r->count, (double)r->count / SIM_HZ, (double)r->capacity / SIM_HZ, held / 1024,
+           r->size / 1024, (double)r->bytes_pushed / (double)r->frames_pushed, r->state_size, r->keyframes);
+}
+
+/* -------------------- Environment -------------------- */
+
+/* reset/step/observe interface for automated agents. Actions are the same
+ * INPUT_* bits the replay log stores, so any agent run can be recorded and
+ * replayed. */
+#define OBS_MAX_BULLETS 16
+
+/* Fixed-size view of one game. Bullet counts are totals; only the first
+ * OBS_MAX_BULLETS positions of each kind are filled in. alive is indexed
+ * row * formation_cols + col. */
+typedef struct {
+    Uint32 tick;
+    int score, lives, wave, active;
+    int ship_x;
+    int formation_x, formation_y;
+    int formation_rows, formation_cols;
+    uint64_t alive[ALIEN_WORDS(ALIEN_MAX_COUNT)];
+    int player_bullet_count, alien_bullet_count;
+    Sint16 player_bullets[OBS_MAX_BULLETS][2];
+    Sint16 alien_bullets[OBS_MAX_BULLETS][2];
+} Observation;
+
+/* Starts a fresh episode: the whole game, tick counter included, goes back
+ * to its initial state under the given seed. Pools and their overflow
+ * counts are kept. */
+void game_reset(Game *g, Uint64 seed) {
+    g->tick = 0;
+    g->shake_x = g->shake_y = 0;
+    g->wave_clear_timer = -1;
+    game_seed(g, seed);
+    reset_game(g);
+}
+
+/* Advances one tick under the given INPUT_* bits and returns the score
+ * gained. The episode is over once g->active drops to zero. */
+int game_step(Game *g, Uint8 actions) {
+    Input in;
+    int score = g->score;
+    input_unpack(actions, &in);
+    sim_tick(g, &in);
+    return g->score - score;
+}
+
+void game_observe(const Game *g, Observation *o) {
+    o->tick = g->tick;
+    o->score = g->score;
+    o->lives = g->lives;
+    o->wave = g->wave;
+    o->active = g->active;
+    o->ship_x = g->ship.x;
+    o->formation_x = (int)g->formation.origin_x;
+    o->formation_y = g->formation.origin_y;
+    o->formation_rows = g->formation.rows;
+    o->formation_cols = g->formation.cols;
+    memset(o->alive, 0, sizeof(o->alive));
+    memcpy(o->alive, g->formation.alive, sizeof(uint64_t) * ALIEN_WORDS(g->formation.count));
+    o->player_bullet_count = g->player_bullet_count;
+    o->alien_bullet_count = g->alien_bullet_count;
+    memset(o->player_bullets, 0, sizeof(o->player_bullets));
+    memset(o->alien_bullets, 0, sizeof(o->alien_bullets));
+    for (int i = 0; i < g->player_bullet_count && i < OBS_MAX_BULLETS; ++i) {
+        o->player_bullets[i][0] = (Sint16)g->player_bullets[i].x;
+        o->player_bullets[i][1] = (Sint16)g->player_bullets[i].y;
+    }
+    for (int i = 0; i < g->alien_bullet_count && i < OBS_MAX_BULLETS; ++i) {
+        o->alien_bullets[i][0] = (Sint16)g->alien_bullets[i].x;
+        o->alien_bullets[i][1] = (Sint16)g->alien_bullets[i].y;
+    }
+}
+
+/* Low-resolution observations rasterized straight from the game state into
+ * a caller-owned buffer, with no renderer or readback involved. Each kind
+ * of object is its own channel. OBS_PLANES lays the channels out as
+ * consecutive width*height planes (255 where covered); OBS_PALETTE packs
+ * them into a single plane of 1 + channel index (0 is empty, later
+ * channels draw over earlier ones); OBS_GRAY is that plane with a distinct
+ * gray level per channel. */
+typedef enum { OBS_ALIENS, OBS_SHIP, OBS_PLAYER_BULLETS, OBS_ALIEN_BULLETS, OBS_CHANNELS } ObsChannel;
+typedef enum { OBS_PLANES, OBS_PALETTE, OBS_GRAY } ObsFormat;
+
+typedef struct {
+    int width, height;
+    ObsFormat format;
+} ObsSpec;
+
+static const char *obs_format_names[] = {"planes", "palette", "gray"};
+static const Uint8 obs_gray_levels[OBS_CHANNELS] = {96, 255, 192, 144};
+
+size_t obs_frame_size(const ObsSpec *spec) {
+    size_t plane = (size_t)spec->width * (size_t)spec->height;
+    return spec->format == OBS_PLANES ? plane * OBS_CHANNELS : plane;
+}
+
+/* Batches keep frames a whole number of cache lines apart so workers
+ * writing neighbouring games never share a line. */
+size_t obs_frame_stride(const ObsSpec *spec) {
+    return (obs_frame_size(spec) + 63) & ~(size_t)63;
+}
+
+/* Scales r onto the observation grid. Anything on screen covers at least
+ * one cell, so 4 px bullets don't vanish at 84x84. */
+static void obs_fill(const ObsSpec *spec, Uint8 *pixels, ObsChannel ch, const SDL_Rect *r) {
+    int x0 = floor_div(r->x * spec->width, WIDTH);
+    int y0 = floor_div(r->y * spec->height, HEIGHT);
+    int x1 = -floor_div(-(r->x + r->w) * spec->width, WIDTH);
+    int y1 = -floor_div(-(r->y + r->h) * spec->height, HEIGHT);
+    if (x1 <= x0) x1 = x0 + 1;
+    if (y1 <= y0) y1 = y0 + 1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > spec->width) x1 = spec->width;
+    if (y1 > spec->height) y1 = spec->height;
+    if (x0 >= x1 || y0 >= y1) return;
+
+    Uint8 value;
+    if (spec->format == OBS_PLANES) {
+        pixels += (size_t)ch * (size_t)spec->width * (size_t)spec->height;
+        value = 255;
+    } else {
+        value = spec->format == OBS_PALETTE ? (Uint8)(ch + 1) : obs_gray_levels[ch];
+    }
+    for (int y = y0; y < y1; ++y) memset(pixels + (size_t)y * (size_t)spec->width + x0, value, (size_t)(x1 - x0));
+}
+
+/* Writes obs_frame_size(spec) bytes to pixels. */
+void game_rasterize(const Game *g, const ObsSpec *spec, Uint8 *pixels) {
+    memset(pixels, 0, obs_frame_size(spec));
+    const AlienStore *f = &g->formation;
+    for (int w = 0; w < ALIEN_WORDS(f->count); ++w) {
+        for (uint64_t bits = f->alive[w]; bits; bits &= bits - 1) {
+            SDL_Rect a = alien_rect(f, w * 64 + __builtin_ctzll(bits));
+            obs_fill(spec, pixels, OBS_ALIENS, &a);
+        }
+    }
+    obs_fill(spec, pixels, OBS_SHIP, &g->ship);
+    for (int i = 0; i < g->player_bullet_count; ++i) {
+        obs_fill(spec, pixels, OBS_PLAYER_BULLETS, &g->player_bullets[i]);
+    }
+    for (int i = 0; i < g->alien_bullet_count; ++i) {
+        obs_fill(spec, pixels, OBS_ALIEN_BULLETS, &g->alien_bullets[i]);
+    }
+}
+
+/* Batch frames can be placed in a named POSIX shared memory object so a
+ * trainer process maps the same pages instead of receiving copies. The
+ * object starts with an ObsShmHeader; game i's frame is at
+ * frame_offset + i * frame_stride. The frames are rewritten in place, so
+ * generation works as a seqlock: it turns odd before a step writes any frame
+ * and even once all are written. A reader reads it, copies the frames and
+ * reads it again; the copy is whole only if both reads gave the same even
+ * value. */
+#define OBS_SHM_MAGIC 0x5342304Fu   /* "O0BS" */
+
+typedef struct {
+    Uint32 magic;
+    Uint32 width, height;
+    Uint32 format;
+    Uint32 channels;
+    Uint32 games;
+    Uint32 frame_size;
+    Uint32 frame_stride;
+    Uint32 frame_offset;
+    SDL_atomic_t generation;
+} ObsShmHeader;
+
+typedef struct {
+    void *base;
+    size_t size;
+    ObsShmHeader *header;
+    Uint8 *frames;
+} ObsShm;
+
+#ifdef VADERS_HAVE_SHM
+int obs_shm_open(ObsShm *s, const char *name, const ObsSpec *spec, int games) {
+    memset(s, 0, sizeof(*s));
+    size_t offset = (sizeof(ObsShmHeader) + 63) & ~(size_t)63;
+    s->size = offset + obs_frame_stride(spec) * (size_t)games;
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        SDL_Log("Failed to create shared memory %s: %s", name, strerror(errno));
+        return 0;
+    }
+    if (ftruncate(fd, (off_t)s->size) != 0) {
+        SDL_Log("Failed to size shared memory %s: %s", name, strerror(errno));
+        close(fd);
+        return 0;
+    }
+    s->base = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s->base == MAP_FAILED) {
+        SDL_Log("Failed to map shared memory %s: %s", name, strerror(errno));
+        s->base = NULL;
+        return 0;
+    }
+    s->header = s->base;
+    s->frames = (Uint8 *)s->base + offset;
+    s->header->width = (Uint32)spec->width;
+    s->header->height = (Uint32)spec->height;
+    s->header->format = (Uint32)spec->format;
+    s->header->channels = spec->format == OBS_PLANES ? OBS_CHANNELS : 1;
+    s->header->games = (Uint32)games;
+    s->header->frame_size = (Uint32)obs_frame_size(spec);
+    s->header->frame_stride = (Uint32)obs_frame_stride(spec);
+    s->header->frame_offset = (Uint32)offset;
+    SDL_AtomicSet(&s->header->generation, 0);
+    SDL_MemoryBarrierRelease();
+    s->header->magic = OBS_SHM_MAGIC;
+    return 1;
+}
+
+/* Unmaps our view. The object itself stays until the trainer (or shm_unlink
+ * by name) removes it, so a reader can attach after we exit. */
+void obs_shm_close(ObsShm *s) {
+    if (s->base) munmap(s->base, s->size);
+    memset(s, 0, sizeof(*s));
+}
+#else
+int obs_shm_open(ObsShm *s, const char *name, const ObsSpec *spec, int games) {
+    (void)spec;
+    (void)games;
+    memset(s, 0, sizeof(*s));
+    SDL_Log("Shared memory observations (%s) are not supported on this platform", name);
+    return 0;
+}
+
+void obs_shm_close(ObsShm *s) {
+    memset(s, 0, sizeof(*s));
+}
+#endif
+
+/* -------------------- Batch Runner -------------------- */
+
+/* Steps many independent games across a pool of worker threads. The games
+ * are cut into chunks of BATCH_CHUNK; each worker owns a deque of chunks,
+ * takes work from its front and, once empty, steals from the back of the
+ * others, so workers whose games are cheap (or finished) pick up the slack
+ * from busy ones. The calling thread works as worker 0. */
+#define BATCH_CHUNK 4
+
+typedef enum { BATCH_STEP, BATCH_RUN, BATCH_RASTERIZE } BatchJob;
+
+typedef struct {
+    int *chunks;
+    int head, tail;         /* owner pops at head, thieves take from tail */
+    SDL_SpinLock lock;
+} WorkDeque;
+
+typedef struct Batch Batch;
+
+typedef struct {
+    Batch *batch;
+    int index;
+    WorkDeque deque;
+    SDL_Thread *thread;
+} BatchWorker;
+
+struct Batch {
+    Arena arena;            /* games, their pools and the per-game counters */
+    Limits limits;
+    Game *games;
+    int count;
+    Uint64 seed;
+    long *episodes;         /* per game, finished episodes so far */
+    int *best_score;        /* per game */
+    ObsSpec obs;
+    Uint8 *obs_frames;      /* optional, count frames obs_frame_stride() apart */
+    SDL_atomic_t *obs_generation;   /* optional seqlock the frames are written under */
+    BatchWorker *workers;
+    int worker_count;
+    int chunk_count;
+    SDL_sem *start, *done;
+    int quit;
+    SDL_atomic_t steals;
+    /* The job being dispatched. */
+    BatchJob job;
+    const Uint8 *actions;
+    int *rewards;
+    Uint8 *dones;
+    int run_steps;
+};
+
+static Uint64 batch_episode_seed(const Batch *b, int i) {
+    return b->seed ^ ((Uint64)i * 0x9E3779B97F4A7C15ull) ^ ((Uint64)b->episodes[i] << 40);
+}
+
+static int work_pop(WorkDeque *d) {
+    int chunk = -1;
+    SDL_AtomicLock(&d->lock);
+    if (d->head < d->tail) chunk = d->chunks[d->head++];
+    SDL_AtomicUnlock(&d->lock);
+    return chunk;
+}
+
+static int work_steal(WorkDeque *d) {
+    int chunk = -1;
+    SDL_AtomicLock(&d->lock);
+    if (d->head < d->tail) chunk = d->chunks[--d->tail];
+    SDL_AtomicUnlock(&d->lock);
+    return chunk;
+}
+
+/* Autopilot play with automatic restarts; a game that ends is reset under a
+ * new seed right away so every game keeps its slot busy. */
+static void batch_run_game(Batch *b, int i) {
+    Game *g = &b->games[i];
+    for (int s = 0; s < b->run_steps; ++s) {
+        Input in;
+        autopilot_input(g, &in);
+        in.restart = 0;
+        game_step(g, input_pack(&in));
+        if (!g->active) {
+            if (g->score > b->best_score[i]) b->best_score[i] = g->score;
+            b->episodes[i]++;
+            game_reset(g, batch_episode_seed(b, i));
+        }
+    }
+}
+
+static void batch_run_chunk(Batch *b, int chunk) {
+    int first = chunk * BATCH_CHUNK;
+    int last = first + BATCH_CHUNK < b->count ? first + BATCH_CHUNK : b->count;
+    for (int i = first; i < last; ++i) {
+        if (b->job == BATCH_RUN) {
+            batch_run_game(b, i);
+        } else if (b->job == BATCH_RASTERIZE) {
+            game_rasterize(&b->games[i], &b->obs, b->obs_frames + obs_frame_stride(&b->obs) * (size_t)i);
+        } else if (b->games[i].active) {
+            b->rewards[i] = game_step(&b->games[i], b->actions[i]);
+            b->dones[i] = !b->games[i].active;
+        } else {
+            b->rewards[i] = 0;
+            b->dones[i] = 1;
+        }
+        if (b->obs_frames && b->job == BATCH_STEP) {
+            game_rasterize(&b->games[i], &b->obs, b->obs_frames + obs_frame_stride(&b->obs) * (size_t)i);
+        }
+    }
+}
+
+static void batch_work(BatchWorker *w) {
+    Batch *b = w->batch;
+    for (;;) {
+        int chunk = work_pop(&w->deque);
+        for (int k = 1; chunk < 0 && k < b->worker_count; ++k) {
+            chunk = work_steal(&b->workers[(w->index + k) % b->worker_count].deque);
+            if (chunk >= 0) SDL_AtomicAdd(&b->steals, 1);
+        }
+        /* No work is added mid-dispatch, so empty everywhere means done. */
+        if (chunk < 0) return;
+        batch_run_chunk(b, chunk);
+    }
+}
+
+static int batch_thread_main(void *data) {
+    BatchWorker *w = data;
+    for (;;) {
+        SDL_SemWait(w->batch->start);
+        if (w->batch->quit) return 0;
+        batch_work(w);
+        SDL_SemPost(w->batch->done);
+    }
+}
+
+/* Brackets every write to the frames. SDL's atomic add is a full barrier,
+ * and the workers' writes are ordered before the end by the done semaphore. */
+static void batch_obs_write_begin(Batch *b) {
+    if (b->obs_frames && b->obs_generation) SDL_AtomicAdd(b->obs_generation, 1);
+}
+
+static void batch_obs_write_end(Batch *b) {
+    if (b->obs_frames && b->obs_generation) SDL_AtomicAdd(b->obs_generation, 1);
+}
+
+/* Deals the chunks out round-robin, runs the job to completion on every
+ * worker and returns once all of them are idle again. */
+static void batch_dispatch(Batch *b, BatchJob job) {
+    b->job = job;
+    for (int t = 0; t < b->worker_count; ++t) b->workers[t].deque.head = b->workers[t].deque.tail = 0;
+    for (int c = 0; c < b->chunk_count; ++c) {
+        WorkDeque *d = &b->workers[c % b->worker_count].deque;
+        d->chunks[d->tail++] = c;
+    }
+    for (int t = 1; t < b->worker_count; ++t) SDL_SemPost(b->start);
+    batch_work(&b->workers[0]);
+    for (int t = 1; t < b->worker_count; ++t) SDL_SemWait(b->done);
+}
+
+void batch_free(Batch *b) {
+    if (b->workers) {
+        b->quit = 1;
+        for (int t = 1; t < b->worker_count; ++t) {
+            if (b->workers[t].thread) SDL_SemPost(b->start);
+        }
+        for (int t = 0; t < b->worker_count; ++t) {
+            if (b->workers[t].thread) SDL_WaitThread(b->workers[t].thread, NULL);
+        }
+    }
+    if (b->start) SDL_DestroySemaphore(b->start);
+    if (b->done) SDL_DestroySemaphore(b->done);
+    arena_free(&b->arena);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Creates count games, each seeded from seed and its index, and a pool of
+ * threads workers (the caller counts as one). Everything but the threads
+ * themselves comes from one arena. */
+int batch_init(Batch *b, int count, int threads, const Limits *limits, Uint64 seed) {
+    memset(b, 0, sizeof(*b));
+    if (count < 1) count = 1;
+    if (threads < 1) threads = 1;
+    b->limits = *limits;
+    b->seed = seed;
+    b->chunk_count = (count + BATCH_CHUNK - 1) / BATCH_CHUNK;
+    if (threads > b->chunk_count) threads = b->chunk_count;
+    size_t bytes = arena_round(sizeof(Game) * (size_t)count) + arena_round(sizeof(long) * (size_t)count) +
+                   arena_round(sizeof(int) * (size_t)count) + arena_round(sizeof(BatchWorker) * (size_t)threads) +
+                   arena_round(sizeof(int) * (size_t)b->chunk_count) * (size_t)threads +
+                   game_footprint(limits) * (size_t)count;
+    if (!arena_init(&b->arena, bytes)) return 0;
+    b->games = arena_alloc(&b->arena, sizeof(Game) * (size_t)count);
+    b->episodes = arena_alloc(&b->arena, sizeof(long) * (size_t)count);
+    b->best_score = arena_alloc(&b->arena, sizeof(int) * (size_t)count);
+    b->workers = arena_alloc(&b->arena, sizeof(BatchWorker) * (size_t)threads);
+    b->start = SDL_CreateSemaphore(0);
+    b->done = SDL_CreateSemaphore(0);
+    if (!b->games || !b->episodes || !b->best_score || !b->workers || !b->start || !b->done) {
+        batch_free(b);
+        return 0;
+    }
+    b->count = count;
+    for (int i = 0; i < count; ++i) {
+        if (!game_init(&b->games[i], &b->arena, limits)) {
+            batch_free(b);
+            return 0;
+        }
+        game_reset(&b->games[i], batch_episode_seed(b, i));
+    }
+    b->worker_count = threads;
+    for (int t = 0; t < threads; ++t) {
+        BatchWorker *w = &b->workers[t];
+        w->batch = b;
+        w->index = t;
+        w->deque.chunks = arena_alloc(&b->arena, sizeof(int) * (size_t)b->chunk_count);
+        if (!w->deque.chunks) {
+            batch_free(b);
+            return 0;
+        }
+    }
+    for (int t = 1; t < threads; ++t) {
+        b->workers[t].thread = SDL_CreateThread(batch_thread_main, "batch", &b->workers[t]);
+        if (!b->workers[t].thread) {
+            SDL_Log("Failed to start batch worker: %s", SDL_GetError());
+            batch_free(b);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* One tick for every game under its own action bits. Finished games are
+ * left alone (reward 0, done 1) until batch_reset brings them back. */
+void batch_step(Batch *b, const Uint8 *actions, int *rewards, Uint8 *dones) {
+    b->actions = actions;
+    b->rewards = rewards;
+    b->dones = dones;
+    batch_obs_write_begin(b);
+    batch_dispatch(b, BATCH_STEP);
+    batch_obs_write_end(b);
+}
+
+void batch_reset(Batch *b, int i) {
+    b->episodes[i]++;
+    game_reset(&b->games[i], batch_episode_seed(b, i));
+    if (b->obs_frames) {
+        batch_obs_write_begin(b);
+        game_rasterize(&b->games[i], &b->obs, b->obs_frames + obs_frame_stride(&b->obs) * (size_t)i);
+        batch_obs_write_end(b);
+    }
+}
+
+/* From now on every step also rasterizes each game into frames, which the
+ * caller owns (plain memory or an ObsShm) and sizes for count frames. When
+ * another process reads them, generation is the seqlock they are written
+ * under (see ObsShmHeader); otherwise it is NULL. */
+void batch_set_observations(Batch *b, const ObsSpec *spec, Uint8 *frames, SDL_atomic_t *generation) {
+    b->obs = *spec;
+    b->obs_frames = frames;
+    b->obs_generation = generation;
+    batch_obs_write_begin(b);
+    for (int i = 0; frames && i < b->count; ++i) {
+        game_rasterize(&b->games[i], spec, frames + obs_frame_stride(spec) * (size_t)i);
+    }
+    batch_obs_write_end(b);
+}
+
+void batch_observe(const Batch *b, Observation *out) {
+    for (int i = 0; i < b->count; ++i) game_observe(&b->games[i], &out[i]);
+}
+
+/* Plays steps ticks of every game under the autopilot, restarting games as
+ * they end. */
+void batch_run(Batch *b, int steps) {
+    b->run_steps = steps;
+    batch_dispatch(b, BATCH_RUN);
+    /* Nothing reads the frames mid-run, so only the final states are drawn,
+     * in a pass of their own to keep the seqlock's write window short. */
+    if (b->obs_frames) {
+        batch_obs_write_begin(b);
+        batch_dispatch(b, BATCH_RASTERIZE);
+        batch_obs_write_end(b);
+    }
+}
+
+/* -------------------- Snapshots -------------------- */
+
+void snapshot_capture(Snapshot *s, const Game *g, Uint64 tick_time) {
+    s->tick = g->tick;
+    s->tick_time = tick_time;
+    s->ship_fx = g->ship_fx;
+    s->ship_prev_fx = g->ship_prev_fx;
+    s->ship_y = g->ship.y;
+    s->invuln_timer = g->invuln_timer;
+    s->muzzle_timer = g->muzzle_timer;
+    s->shake_x = g->shake_x;
+    s->shake_y = g->shake_y;
+    s->score = g->score;
+    s->lives = g->lives;
+    s->wave = g->wave;
+    s->active = g->active;
+    alien_store_copy(&s->formation, &g->formation);
+    s->player_bullet_count = g->player_bullet_count;
+    s->alien_bullet_count = g->alien_bullet_count;
+    memcpy(s->player_bullets, g->player_bullets, sizeof(SDL_Rect) * (size_t)g->player_bullet_count);
+    memcpy(s->alien_bullets, g->alien_bullets, sizeof(SDL_Rect) * (size_t)g->alien_bullet_count);
+
+    const ParticlePool *src = &g->particles;
+    ParticlePool *p = &s->particles;
+    int n = src->count < p->capacity ? src->count : p->capacity;
+    size_t bytes = sizeof(float) * (size_t)n;
+    memcpy(p->x, src->x, bytes);
+    memcpy(p->y, src->y, bytes);
+    memcpy(p->vx, src->vx, bytes);
+    memcpy(p->vy, src->vy, bytes);
+    memcpy(p->life, src->life, bytes);
+    p->count = n;
+}
+
+/* Triple buffer between one producer (the simulation) and one consumer (the
+ * renderer). Each side owns a slot outright and the third sits in `shared`;
+ * publishing and acquiring are a single atomic swap with it, so neither side
+ * ever blocks and the consumer always holds a complete snapshot. */
+#define SNAPSHOT_FRESH 4   /* set in `shared` until the consumer takes it */
+
+typedef struct {
+    Snapshot slots[3];
+    int write;              /* producer's slot */
+    int read;               /* consumer's slot */
+    SDL_atomic_t shared;
+} SnapshotBuffer;
+
+static SnapshotBuffer snapshots;
+
+size_t snapshot_buffer_footprint(const Limits *l) {
+    return 3 * (alien_store_footprint(l->alien_rows, l->alien_cols) +
+                arena_round(sizeof(SDL_Rect) * (size_t)l->bullets * 2) + particles_footprint(l->particles));
+}
+
+int snapshot_buffer_init(SnapshotBuffer *b, Arena *a, const Limits *l) {
+    memset(b, 0, sizeof(*b));
+    for (int i = 0; i < 3; ++i) {
+        Snapshot *s = &b->slots[i];
+        if (!alien_store_init(&s->formation, a, l->alien_rows, l->alien_cols)) return 0;
+        s->player_bullets = arena_alloc(a, sizeof(SDL_Rect) * (size_t)l->bullets * 2);
+        if (!s->player_bullets) return 0;
+        s->alien_bullets = s->player_bullets + l->bullets;
+        if (!particles_init(&s->particles, a, l->particles)) return 0;
+    }
+    b->write = 0;
+    SDL_AtomicSet(&b->shared, 1);
+    b->read = 2;
+    return 1;
+}
+
+/* Producer: the slot to capture the next snapshot into. */
+static inline Snapshot *snapshot_back(SnapshotBuffer *b) {
+    return &b->slots[b->write];
+}
+
+void snapshot_publish(SnapshotBuffer *b) {
+    SDL_MemoryBarrierRelease();
+    b->write = SDL_AtomicSet(&b->shared, b->write | SNAPSHOT_FRESH) & 3;
+}
+
+/* Consumer: the newest published snapshot, or the current one if nothing
+ * newer has been published since the last call. */
+const Snapshot *snapshot_acquire(SnapshotBuffer *b) {
+    if (SDL_AtomicGet(&b->shared) & SNAPSHOT_FRESH) {
+        b->read = SDL_AtomicSet(&b->shared, b->read) & 3;
+        SDL_MemoryBarrierAcquire();
+    }
+    return &b->slots[b->read];
+}
+
+typedef struct {
+    Uint64 time;     /* perf counter time the key event happened */
+    Uint32 tick;     /* once applied: the tick whose snapshot first shows it */
+    Uint8 key;       /* one of the INPUT_* bits */
+    Uint8 down;
+} InputEvent;
+
+/* Single-producer/single-consumer ring of key events, like SoundQueue. */
+#define INPUT_QUEUE_SIZE 128  /* power of two */
+
+typedef struct {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SDL_atomic_t dropped;
+} InputQueue;
+
+static int input_queue_push(InputQueue *q, const InputEvent *e) {
+    unsigned head = (unsigned)SDL_AtomicGet(&q->head);
+    unsigned tail = (unsigned)SDL_AtomicGet(&q->tail);
+    if (head - tail >= INPUT_QUEUE_SIZE) {
+        SDL_AtomicAdd(&q->dropped, 1);
+        return 0;
+    }
+    q->events[head & (INPUT_QUEUE_SIZE - 1)] = *e;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&q->head, (int)(head + 1));
+    return 1;
+}
+
+/* Consumer: the oldest event, left queued until input_queue_pop. */
+static const InputEvent *input_queue_peek(InputQueue *q) {
+    unsigned tail = (unsigned)SDL_AtomicGet(&q->tail);
+    if ((unsigned)SDL_AtomicGet(&q->head) == tail) return NULL;
+    SDL_MemoryBarrierAcquire();
+    return &q->events[tail & (INPUT_QUEUE_SIZE - 1)];
+}
+
+static void input_queue_pop(InputQueue *q) {
+    SDL_AtomicAdd(&q->tail, 1);
+}
+
+/* Key events handed from the event loop to whichever thread runs the ticks,
+ * each stamped with when it happened. When several ticks are run back to
+ * back, each applies only the events up to its own due time, so a press
+ * lands on the tick it occurred in; the newest tick takes everything up to
+ * now, since no later tick could show it sooner. Held keys become levels on
+ * the tick side; presses go back on `applied` with the tick that took them,
+ * for the latency probe. */
+typedef struct {
+    InputQueue events;     /* event loop -> ticks */
+    InputQueue applied;    /* ticks -> latency probe */
+    int left, right;       /* held keys, owned by the tick side */
+    int rewind;
+} InputLatch;
+
+void input_latch_push(InputLatch *l, int key, int down, Uint64 time) {
+    InputEvent e = {time, 0, (Uint8)key, (Uint8)down};
+    input_queue_push(&l->events, &e);
+}
+
+/* Fills in the input for a tick taking events up to `upto`, whose snapshot
+ * will carry tick number `tick`. */
+void input_latch_take(InputLatch *l, Input *in, Uint64 upto, Uint32 tick) {
+    memset(in, 0, sizeof(*in));
+    int left_pressed = 0, right_pressed = 0;
+    const InputEvent *e;
+    while ((e = input_queue_peek(&l->events)) && e->time <= upto) {
+        switch (e->key) {
+            case INPUT_LEFT:    l->left = e->down; left_pressed |= e->down; break;
+            case INPUT_RIGHT:   l->right = e->down; right_pressed |= e->down; break;
+            case INPUT_FIRE:    in->fire = 1; break;
+            case INPUT_RESTART: in->restart = 1; break;
+            case INPUT_REWIND:  l->rewind = e->down; break;
+        }
+        if (e->down) {
+            InputEvent applied = *e;
+            applied.tick = tick;
+            input_queue_push(&l->applied, &applied);
+        }
+        input_queue_pop(&l->events);
     }
+    /* A tap shorter than a tick still moves the ship for that tick. */
+    in->left = l->left || left_pressed;
+    in->right = l->right || right_pressed;
+    in->rewind = l->rewind;
 }
 
-void play_beep(double freq, int dur_ms, Waveform wave, ADSR env) {
-    SDL_LockAudioDevice(audio.device);
-    env.attack /= 1000.0;
-    env.decay  /= 1000.0;
-    env.release/= 1000.0;
-    if (env.attack < 0) env.attack = 0;
-    if (env.decay < 0) env.decay = 0;
-    if (env.release < 0) env.release = 0;
-    env.sustain = (dur_ms / 1000.0) - (env.attack + env.decay + env.release);
-    if (env.sustain < 0) env.sustain = 0;
-    double total = env.attack + env.decay + env.sustain + env.release;
-    for (int i = 0; i < MAX_ACTIVE_SOUNDS; ++i) {
-        if (!sounds[i].active) {
-            sounds[i].active = 1;
-            sounds[i].freq = freq;
-            sounds[i].phase = 0;
-            sounds[i].t = 0;
-            sounds[i].wave = wave;
-            sounds[i].env = env;
-            sounds[i].total = total;
-            break;
+/* One simulation tick with replay playback and recording applied. Holding
+ * rewind steps back one recorded tick instead, unless a replay is being
+ * played or recorded, whose log can't follow; with rewind off or its
+ * history used up the tick is simulated as usual. Returns 0, having done
+ * nothing else, on the tick the replay log runs out. */
+int run_tick(Game *g, Input *in, Replay *play, Replay *rec, Rewind *rw, Uint64 due) {
+    if (in->rewind && !play->fp && !rec->fp && rw->frames && rewind_restore(rw, g, g->tick - 1)) return 1;
+    if (play->fp) {
+        /* Play the log back; once it runs out, in takes over from the next tick. */
+        Uint8 bits;
+        if (!replay_read(play, &bits)) {
+            play->matched = replay_verify(play, g);
+            replay_close(play);
+            return 0;
         }
+        input_unpack(bits, in);
     }
-    SDL_UnlockAudioDevice(audio.device);
-    SDL_PauseAudioDevice(audio.device, 0);
+    if (rec->fp) replay_write(rec, input_pack(in));
+    rewind_push(rw, g, input_pack(in));
+    g->tick_time = due;
+    sim_tick(g, in);
+    return 1;
 }
 
-void schedule_beep(double freq, int dur_ms, Waveform wave, ADSR env, int delay_ms) {
-    if (pending_count >= MAX_PENDING_SOUNDS) return;
-    pending_sounds[pending_count++] = (PendingSound){freq, dur_ms, wave, env, delay_ms};
+/* Holds rewind for one tick: it must step back while history remains and
+ * simulate forward once it is used up or rewind is off. */
+int rewind_hold_check(Game *g, Rewind *rw) {
+    Replay none = {0};
+    Input in = {0};
+    in.rewind = 1;
+    Uint32 tick = g->tick;
+    int held = rewind_holds(rw, tick - 1);
+    run_tick(g, &in, &none, &none, rw, 0);
+    int ok = g->tick == (held ? tick - 1 : tick + 1);
+    printf("rewind: held rewind %s\n", ok ? (held ? "stepped back" : "advanced with no history") : "STALLED");
+    return ok;
 }
 
-void update_sounds(int dt_ms) {
-    for (int i = 0; i < pending_count; ) {
-        pending_sounds[i].delay_ms -= dt_ms;
-        if (pending_sounds[i].delay_ms <= 0) {
-            play_beep(pending_sounds[i].freq, pending_sounds[i].dur_ms,
-                     pending_sounds[i].wave, pending_sounds[i].env);
-            pending_sounds[i] = pending_sounds[--pending_count];
-        } else {
-            ++i;
+/* Runs the fixed-rate simulation on its own thread, publishing a snapshot
+ * after every tick, so a stalled present can't hold up game time and a slow
+ * tick can't delay a present. */
+typedef struct {
+    SDL_atomic_t running;
+    InputLatch *input;
+    SnapshotBuffer *snapshots;
+    Replay *play, *rec;
+    Rewind *rewind;
+    Uint64 tick_period;
+    Uint64 max_lag;
+} SimThread;
+
+static int sim_thread_main(void *data) {
+    SimThread *st = data;
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 next = SDL_GetPerformanceCounter() + st->tick_period;
+    while (SDL_AtomicGet(&st->running)) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now < next) {
+            /* Sleep in 1 ms steps, then yield through the last one. */
+            SDL_Delay((next - now) * 1000 / freq >= 1 ? 1 : 0);
+            continue;
         }
+        /* Like the accumulator clamp: drop time rather than spiral. */
+        if (now - next > st->max_lag) next = now;
+
+        Input in;
+        input_latch_take(st->input, &in, now < next + st->tick_period ? now : next, game.tick + 1);
+        run_tick(&game, &in, st->play, st->rec, st->rewind, next);
+        snapshot_capture(snapshot_back(st->snapshots), &game, next);
+        snapshot_publish(st->snapshots);
+        next += st->tick_period;
     }
+    return 0;
 }
 
-void enqueue_sound(SoundEvent e) {
-    ADSR env;
-    switch (e) {
-        case SND_PLAYER_SHOT:
-            env = (ADSR){10, 40, 0, 40, 0.6};
-            play_beep(880.0, 120, WAVE_SINE, env);
-            break;
-        case SND_ALIEN_HIT:
-            env = (ADSR){10, 150, 0, 150, 0.5};
-            play_beep(220.0, 300, WAVE_SQUARE, env);
-            env = (ADSR){5, 60, 0, 60, 0.5};
-            play_beep(0.0, 120, WAVE_NOISE, env);
-            break;
-        case SND_ALIEN_SHOT:
-            env = (ADSR){5, 30, 0, 30, 0.6};
-            play_beep(660.0, 80, WAVE_SINE, env);
-            break;
-        case SND_PLAYER_HIT:
-            env = (ADSR){10, 100, 0, 100, 0.6};
-            play_beep(180.0, 250, WAVE_SINE, env);
-            break;
-        case SND_WAVE_CLEAR:
-            env = (ADSR){5, 50, 0, 50, 0.6};
-            schedule_beep(440.0, 120, WAVE_SINE, env, 0);
-            schedule_beep(660.0, 120, WAVE_SINE, env, 150);
-            schedule_beep(880.0, 120, WAVE_SINE, env, 300);
-            break;
+/* -------------------- Rendering -------------------- */
+
+#define PROF_BAR_PX_PER_MS 40
+#define PROF_BAR_MAX 120
+
+static const SDL_Color prof_phase_colors[PROF_PHASE_COUNT] = {
+    {255, 160, 0, 255}, {255, 80, 160, 255}, {0, 255, 0, 255}, {255, 60, 60, 255},
+    {0, 200, 120, 255}, {80, 140, 255, 255}, {255, 255, 255, 255}, {200, 120, 255, 255}
+};
+
+/* Per-phase bars (smoothed ms, label, microseconds) and the frame counters,
+ * drawn to the right of the HUD. Toggled with F3. */
+void draw_profiler_overlay(SDL_Renderer *renderer) {
+    int x = 580, y = 34;
+    int rows = PROF_PHASE_COUNT + PROF_COUNTER_COUNT;
+    SDL_Rect bg = {x - 4, y - 4, WIDTH - x, rows * 10 + 6};
+    render_set_color(renderer, 0, 0, 0, 160);
+    render_fill_rect(renderer, &bg);
+    for (int i = 0; i < PROF_PHASE_COUNT; ++i, y += 10) {
+        SDL_Color c = prof_phase_colors[i];
+        render_set_color(renderer, c.r, c.g, c.b, 255);
+        draw_text_block(renderer, x, y, 1, prof_phase_names[i]);
+        int w = (int)(profiler.phase_ms[i] * PROF_BAR_PX_PER_MS);
+        if (w > PROF_BAR_MAX) w = PROF_BAR_MAX;
+        SDL_Rect bar = {x + 56, y, w > 0 ? w : 1, 7};
+        render_fill_rect(renderer, &bar);
+        draw_number(renderer, x + 180, y, 1, (int)(profiler.phase_ms[i] * 1000.0f));
+    }
+    render_set_color(renderer, COLOR_HUD.r, COLOR_HUD.g, COLOR_HUD.b, 255);
+    for (int i = 0; i < PROF_COUNTER_COUNT; ++i, y += 10) {
+        draw_text_block(renderer, x, y, 1, prof_counter_names[i]);
+        draw_number(renderer, x + 80, y, 1, profiler.shown_counters[i]);
     }
 }
 
-/* -------------------- Game Helpers -------------------- */
+static int lerp_i(float from, float to, float alpha) {
+    return (int)(from + (to - from) * alpha);
+}
 
-void init_wave(int wave_number) {
-    player_bullet_count = 0;
-    alien_bullet_count = 0;
-    for (int r = 0; r < ALIEN_ROWS; ++r) {
-        for (int c = 0; c < ALIEN_COLS; ++c) {
-            int idx = r * ALIEN_COLS + c;
-            float ax = 100 + c * (ALIEN_WIDTH + ALIEN_H_SPACING);
-            float ay = 50 + r * (ALIEN_HEIGHT + ALIEN_V_SPACING);
-            alien_fx[idx] = ax;
-            aliens[idx] = (SDL_Rect){(int)ax, (int)ay, ALIEN_WIDTH, ALIEN_HEIGHT};
-            alien_alive[idx] = 1;
-        }
-    }
-    alien_direction = 1;
-    alien_base_speed = ALIEN_SPEED * powf(1.1f, wave_number - 1);
-    if (alien_base_speed > 8.0f) alien_base_speed = 8.0f;
-    alien_fire_interval = (int)(1500 / powf(1.1f, wave_number - 1));
-    if (alien_fire_interval < 400) alien_fire_interval = 400;
-    alien_fire_timer = alien_fire_interval;
-    for (int i = 0; i < ALIEN_COUNT; ++i) alien_flash[i] = 0;
-    for (int i = 0; i < PARTICLE_MAX; ++i) particles[i].active = 0;
-    muzzle_timer = 0;
-    shake_timer = 0;
-}
-
-void spawn_alien_bullet(SDL_Rect from) {
-    if (alien_bullet_count >= MAX_BULLETS) return;
-    alien_bullets[alien_bullet_count++] =
-        (SDL_Rect){from.x + from.w / 2 - BULLET_WIDTH / 2, from.y + from.h, BULLET_WIDTH, BULLET_HEIGHT};
-    enqueue_sound(SND_ALIEN_SHOT);
+/* Scene layers: the alien formation and the HUD are each drawn unshaken into
+ * a target texture that is copied to the screen every frame, so between
+ * kills, hit flashes and animation frames the formation costs one copy
+ * instead of a sprite per alien. The formation is drawn relative to its own
+ * origin and copied at the interpolated origin plus the shake offset, so its
+ * march does not invalidate it. The ship, bullets and particles move every
+ * frame and are drawn straight to the screen. Without render targets, or on
+ * the software framebuffer where per-rect offsets are free, everything is
+ * drawn straight to the screen. */
+enum { LAYER_FORMATION, LAYER_HUD, LAYER_COUNT };
+
+typedef struct {
+    SDL_Texture *texture;
+    int valid;
+} Layer;
+
+/* What each layer shows, compared in full before a layer is reused. */
+typedef struct {
+    int alien_frame;
+    int count;
+    uint64_t alive[ALIEN_WORDS(ALIEN_MAX_COUNT)];
+    uint64_t flashing[ALIEN_WORDS(ALIEN_MAX_COUNT)];
+} FormationLook;
+
+typedef struct {
+    int score, lives, wave, active;
+} HudLook;
+
+typedef struct {
+    int enabled;
+    Layer layer[LAYER_COUNT];
+    FormationLook formation;
+    HudLook hud;
+} LayerStack;
+
+static LayerStack layers = {0};
+
+void layers_free(void) {
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        if (layers.layer[i].texture) SDL_DestroyTexture(layers.layer[i].texture);
+    }
+    memset(&layers, 0, sizeof(layers));
 }
 
-void spawn_particles(int x, int y) {
-    int n = 12 + rand() % 9;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < PARTICLE_MAX; ++j) {
-            if (!particles[j].active) {
-                float angle = (float)rand() / RAND_MAX * 2.0f * (float)M_PI;
-                float speed = 50.0f + rand() % 100; /* px per second */
-                particles[j].active = 1;
-                particles[j].life = PARTICLE_LIFETIME;
-                particles[j].x = (float)x;
-                particles[j].y = (float)y;
-                particles[j].vx = cosf(angle) * speed;
-                particles[j].vy = sinf(angle) * speed;
-                break;
-            }
+int layers_init(SDL_Renderer *renderer) {
+    if (softfb.enabled || !SDL_RenderTargetSupported(renderer)) return 0;
+    /* Blending onto a transparent clear leaves premultiplied color behind. */
+    SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(
+        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+                                                 SDL_TEXTUREACCESS_TARGET, WIDTH, HEIGHT);
+        layers.layer[i].texture = texture;
+        if (!texture || SDL_SetTextureBlendMode(texture, premultiplied) != 0) {
+            SDL_Log("Failed to create render layers: %s", SDL_GetError());
+            layers_free();
+            return 0;
         }
     }
+    layers.enabled = 1;
+    return 1;
 }
 
-void update_particles(int dt) {
-    for (int i = 0; i < PARTICLE_MAX; ++i) {
-        if (!particles[i].active) continue;
-        particles[i].life -= dt;
-        if (particles[i].life <= 0) {
-            particles[i].active = 0;
-            continue;
+/* Target contents are lost on a device reset. */
+void invalidate_layers(void) {
+    for (int i = 0; i < LAYER_COUNT; ++i) layers.layer[i].valid = 0;
+}
+
+/* Makes the layer the render target and clears it, unless it already shows
+ * look; returns whether the caller has to draw it and then call layer_end. */
+static int layer_begin(SDL_Renderer *renderer, int index, void *shown, const void *look, size_t size) {
+    Layer *l = &layers.layer[index];
+    if (l->valid && memcmp(shown, look, size) == 0) return 0;
+    memcpy(shown, look, size);
+    render_set_target(renderer, l->texture);
+    render_set_color(renderer, 0, 0, 0, 0);
+    render_clear(renderer);
+    l->valid = 1;
+    prof_count(PROF_LAYER_DRAWS, 1);
+    return 1;
+}
+
+static void layer_end(SDL_Renderer *renderer) {
+    render_set_target(renderer, NULL);
+}
+
+static void layer_copy(SDL_Renderer *renderer, int index, int x, int y) {
+    SDL_Rect dst = {x, y, WIDTH, HEIGHT};
+    render_copy(renderer, layers.layer[index].texture, NULL, &dst);
+}
+
+/* Interpolated positions the playfield is drawn at this frame. */
+typedef struct {
+    int formation_x;
+    int ship_x;
+    int ship_visible;
+    int alien_frame;
+    int bullet_lag;
+} PlayfieldView;
+
+static void playfield_view(const Snapshot *s, float alpha, PlayfieldView *v) {
+    v->formation_x = lerp_i(s->formation.prev_origin_x, s->formation.origin_x, alpha);
+    v->ship_x = lerp_i(s->ship_prev_fx, s->ship_fx, alpha);
+    v->ship_visible = s->invuln_timer <= 0 || (SDL_GetTicks() / 100) % 2 == 0;
+    v->alien_frame = (SDL_GetTicks() / 500) % 2;
+    /* Bullets move at a constant speed, so their previous position is
+     * implied; they stand still once the game is over. */
+    v->bullet_lag = s->active ? (int)(BULLET_SPEED * (1.0f - alpha)) : 0;
+}
+
+/* Everything draw_formation reads apart from the origin it is drawn at. */
+static void formation_look(const Snapshot *s, const PlayfieldView *v, FormationLook *look) {
+    const AlienStore *f = &s->formation;
+    memset(look, 0, sizeof(*look));
+    look->alien_frame = v->alien_frame;
+    look->count = f->count;
+    memcpy(look->alive, f->alive, sizeof(uint64_t) * ALIEN_WORDS(f->count));
+    for (int i = 0; i < f->count; ++i) {
+        if (f->flash_until[i] > s->tick) look->flashing[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+}
+
+/* Aliens at their cell offsets from (x, y). */
+static void draw_formation(SDL_Renderer *renderer, const Snapshot *s, const PlayfieldView *v, int x, int y) {
+    const AlienStore *f = &s->formation;
+    int alien_scale = ALIEN_WIDTH / ALIEN_BMP_W;
+    for (int i = 0; i < f->count; ++i) {
+        int flashing = f->flash_until[i] > s->tick;
+        if (alien_is_alive(f, i) || flashing) {
+            SDL_Color color = flashing ? COLOR_ALIEN_FLASH : COLOR_ALIEN;
+            int type = (i / f->cols) % ALIEN_TYPES;
+            draw_sprite(renderer, SPRITE_ALIEN(type, v->alien_frame), x + (int)f->col_x[i % f->cols],
+                        y + (int)f->row_y[i / f->cols], alien_scale, color);
         }
-        particles[i].x += particles[i].vx * dt / 1000.0f;
-        particles[i].y += particles[i].vy * dt / 1000.0f;
     }
 }
 
-void draw_particles(SDL_Renderer *renderer) {
-    for (int i = 0; i < PARTICLE_MAX; ++i) {
-        if (!particles[i].active) continue;
-        Uint8 alpha = (Uint8)(255.0f * particles[i].life / PARTICLE_LIFETIME);
-        SDL_SetRenderDrawColor(renderer, COLOR_ALIEN.r, COLOR_ALIEN.g, COLOR_ALIEN.b, alpha);
-        SDL_Rect r = {(int)particles[i].x + shake_x, (int)particles[i].y + shake_y, 2, 2};
-        SDL_RenderFillRect(renderer, &r);
+/* The ship, its muzzle flash and the bullets. */
+static void draw_movers(SDL_Renderer *renderer, const Snapshot *s, const PlayfieldView *v, int ox, int oy) {
+    if (v->ship_visible) {
+        int ship_scale = SHIP_WIDTH / SHIP_BMP_W;
+        draw_sprite(renderer, SPRITE_SHIP, v->ship_x + ox, s->ship_y + oy, ship_scale, COLOR_PLAYER);
+    }
+
+    if (s->muzzle_timer > 0) {
+        render_set_color(renderer, COLOR_PLAYER_BULLET.r, COLOR_PLAYER_BULLET.g, COLOR_PLAYER_BULLET.b, 255);
+        int cx = v->ship_x + SHIP_WIDTH / 2 + ox;
+        int cy = s->ship_y + oy;
+        SDL_Rect r1 = {cx - 1, cy - 8, 2, 8};
+        SDL_Rect r2 = {cx - 4, cy - 4, 8, 2};
+        render_fill_rect(renderer, &r1);
+        render_fill_rect(renderer, &r2);
+    }
+
+    render_set_color(renderer, COLOR_PLAYER_BULLET.r, COLOR_PLAYER_BULLET.g, COLOR_PLAYER_BULLET.b, 255);
+    for (int i = 0; i < s->player_bullet_count; ++i) {
+        SDL_Rect r = s->player_bullets[i];
+        r.x += ox;
+        r.y += oy + v->bullet_lag;
+        render_fill_rect(renderer, &r);
+    }
+    render_set_color(renderer, COLOR_ALIEN_BULLET.r, COLOR_ALIEN_BULLET.g, COLOR_ALIEN_BULLET.b, 255);
+    for (int i = 0; i < s->alien_bullet_count; ++i) {
+        SDL_Rect r = s->alien_bullets[i];
+        r.x += ox;
+        r.y += oy - v->bullet_lag;
+        render_fill_rect(renderer, &r);
     }
 }
 
-void check_collisions(void) {
-    for (int i = 0; i < player_bullet_count;) {
-        player_bullets[i].y -= BULLET_SPEED;
-        int hit = -1;
-        for (int a = 0; a < ALIEN_COUNT; ++a) {
-            if (alien_alive[a] && SDL_HasIntersection(&player_bullets[i], &aliens[a])) { hit = a; break; }
-        }
-        if (hit != -1) {
-            SDL_Rect a = aliens[hit];
-            alien_alive[hit] = 0;
-            alien_flash[hit] = 50;
-            spawn_particles(a.x + a.w / 2, a.y + a.h / 2);
-            shake_timer = SHAKE_DURATION;
-            score += 10;
-            player_bullets[i] = player_bullets[--player_bullet_count];
-            enqueue_sound(SND_ALIEN_HIT);
-            continue;
-        }
-        if (player_bullets[i].y + player_bullets[i].h < 0) {
-            player_bullets[i] = player_bullets[--player_bullet_count];
-        } else {
-            ++i;
+/* alpha is how far (0..1) the frame lies between the previous tick and the
+ * current one; moving objects are drawn at the blended position. The caller
+ * presents, so it can time the submit and the present separately. */
+void render_frame(SDL_Renderer *renderer, const Snapshot *s, float alpha) {
+    Uint64 t = prof_begin();
+    render_set_color(renderer, 0, 0, 0, 255);
+    render_clear(renderer);
+
+    int ox = s->shake_x, oy = s->shake_y;
+    PlayfieldView view;
+    playfield_view(s, alpha, &view);
+    int fx = view.formation_x + ox, fy = s->formation.origin_y + oy;
+    if (layers.enabled) {
+        FormationLook look;
+        formation_look(s, &view, &look);
+        if (layer_begin(renderer, LAYER_FORMATION, &layers.formation, &look, sizeof(look))) {
+            draw_formation(renderer, s, &view, 0, 0);
+            layer_end(renderer);
         }
+        layer_copy(renderer, LAYER_FORMATION, fx, fy);
+    } else {
+        draw_formation(renderer, s, &view, fx, fy);
     }
+    draw_movers(renderer, s, &view, ox, oy);
+    draw_particles(renderer, &s->particles, alpha, ox, oy);
+    prof_end(PROF_DRAW, t);
 
-    for (int i = 0; i < alien_bullet_count;) {
-        alien_bullets[i].y += BULLET_SPEED;
-        if (alien_bullets[i].y > HEIGHT) {
-            alien_bullets[i] = alien_bullets[--alien_bullet_count];
-            continue;
+    t = prof_begin();
+    if (layers.enabled) {
+        HudLook hud = {s->score, s->lives, s->wave, s->active};
+        if (layer_begin(renderer, LAYER_HUD, &layers.hud, &hud, sizeof(hud))) {
+            draw_hud(renderer, s, 0, 0);
+            layer_end(renderer);
         }
-        if (invuln_timer <= 0 && SDL_HasIntersection(&alien_bullets[i], &ship)) {
-            alien_bullets[i] = alien_bullets[--alien_bullet_count];
-            lives--;
-            invuln_timer = 1000;
-            enqueue_sound(SND_PLAYER_HIT);
-            if (lives <= 0) active = 0;
-            continue;
+        layer_copy(renderer, LAYER_HUD, ox, oy);
+    } else {
+        draw_hud(renderer, s, ox, oy);
+    }
+    prof_end(PROF_HUD, t);
+
+    if (profiler.overlay) draw_profiler_overlay(renderer);
+}
+
+/* -------------------- Frame Pacing -------------------- */
+
+/* PACE_VSYNC lets SDL_RenderPresent block on the display, PACE_HYBRID sleeps
+ * until shortly before the deadline and spins the rest on the performance
+ * counter, PACE_UNCAPPED never waits. Frame-to-frame times go into a
+ * histogram so percentiles can be reported on exit.
+ *
+ * With late latching the wait sits at the top of the frame and ends only
+ * `lead` before the next present is due, instead of right after the last
+ * one, so input is polled and the frame simulated and drawn as late as
+ * possible. lead follows a slowly decaying maximum of the recent
+ * wake-to-submit work plus a margin, and grows after a missed deadline. */
+typedef enum { PACE_VSYNC, PACE_HYBRID, PACE_UNCAPPED } PaceMode;
+
+#define PACE_DEFAULT_FPS 60
+#define PACE_SPIN_US 1500
+#define PACE_LATCH_MARGIN_US 1000
+#define FRAME_HIST_BUCKET_US 50
+#define FRAME_HIST_BUCKETS 2000   /* 0..100 ms, plus one overflow bucket */
+
+typedef struct {
+    Uint32 buckets[FRAME_HIST_BUCKETS + 1];
+    Uint64 count;
+    double total_ms;
+    double max_ms;
+} MsHistogram;
+
+typedef struct {
+    PaceMode mode;
+    int late_latch;
+    Uint64 freq;
+    Uint64 period;
+    Uint64 deadline;    /* when the next present is due */
+    Uint64 due;         /* deadline of the frame in flight */
+    Uint64 last;
+    Uint64 wake;        /* when the frame in flight stopped waiting */
+    Uint64 lead;
+    int missed;         /* presents that landed past their deadline */
+    MsHistogram frame_times;
+} FramePacer;
+
+static const char *pace_mode_names[] = {"vsync", "hybrid", "uncapped"};
+
+void hist_record(MsHistogram *h, double ms) {
+    int bucket = (int)(ms * 1000.0 / FRAME_HIST_BUCKET_US);
+    if (bucket > FRAME_HIST_BUCKETS) bucket = FRAME_HIST_BUCKETS;
+    h->buckets[bucket]++;
+    h->count++;
+    h->total_ms += ms;
+    if (ms > h->max_ms) h->max_ms = ms;
+}
+
+double hist_percentile(const MsHistogram *h, double pct) {
+    if (h->count == 0) return 0.0;
+    Uint64 target = (Uint64)(pct / 100.0 * (double)h->count);
+    Uint64 seen = 0;
+    for (int i = 0; i <= FRAME_HIST_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen > target) {
+            double upper = (i + 1) * FRAME_HIST_BUCKET_US / 1000.0;
+            return (i == FRAME_HIST_BUCKETS || upper > h->max_ms) ? h->max_ms : upper;
         }
-        ++i;
     }
+    return h->max_ms;
+}
 
-    for (int i = 0; i < ALIEN_COUNT; ++i) {
-        if (alien_alive[i] && aliens[i].y + aliens[i].h >= ship.y) {
-            active = 0;
-            break;
+void pacer_init(FramePacer *p, PaceMode mode, int fps, int late_latch) {
+    memset(p, 0, sizeof(*p));
+    p->mode = mode;
+    p->late_latch = late_latch && mode != PACE_UNCAPPED;
+    p->freq = SDL_GetPerformanceFrequency();
+    p->period = p->freq / (Uint64)(fps > 0 ? fps : PACE_DEFAULT_FPS);
+    p->last = SDL_GetPerformanceCounter();
+    p->deadline = p->last + p->period;
+    p->lead = p->period / 2;   /* decays to the measured work */
+}
+
+/* Sleeps until shortly before target, then spins the rest. */
+static void pacer_sleep_until(const FramePacer *p, Uint64 target) {
+    Uint64 spin = p->freq * PACE_SPIN_US / 1000000;
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now + spin < target) {
+        SDL_Delay((Uint32)((target - now - spin) * 1000 / p->freq));
+    }
+    while (SDL_GetPerformanceCounter() < target) {
+        /* spin */
+    }
+}
+
+/* Waits until the next frame should start according to the pacing mode and
+ * returns the counter ticks elapsed since the previous call. */
+Uint64 pacer_wait(FramePacer *p) {
+    p->due = p->deadline;
+    if (p->mode == PACE_HYBRID || p->late_latch) {
+        Uint64 target = p->deadline;
+        if (p->late_latch) target = target > p->lead ? target - p->lead : 0;
+        pacer_sleep_until(p, target);
+    }
+    if (p->mode == PACE_HYBRID) {
+        p->deadline += p->period;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now > p->deadline) p->deadline = now + p->period;  /* fell behind; don't burst */
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 elapsed = now - p->last;
+    p->last = now;
+    p->wake = now;
+    hist_record(&p->frame_times, (double)elapsed * 1000.0 / (double)p->freq);
+    return elapsed;
+}
+
+/* Called with the times the frame was submitted and its present returned;
+ * tracks the vsync deadline and adapts the lead. */
+void pacer_frame_done(FramePacer *p, Uint64 submit, Uint64 presented) {
+    if (p->mode == PACE_VSYNC) p->deadline = presented + p->period;
+    if (!p->late_latch) return;
+    Uint64 margin = p->freq * PACE_LATCH_MARGIN_US / 1000000;
+    /* Vsync blocks in present, so only the work before it counts there. */
+    Uint64 work = (p->mode == PACE_VSYNC ? submit : presented) - p->wake + margin;
+    Uint64 decayed = p->lead - p->lead / 64;
+    p->lead = work > decayed ? work : decayed;
+    Uint64 slack = p->mode == PACE_VSYNC ? p->period / 2 : margin;
+    if (presented > p->due + slack) {
+        p->missed++;
+        p->lead += margin;
+    }
+    if (p->lead > p->period) p->lead = p->period;
+}
+
+double pacer_percentile_ms(const FramePacer *p, double pct) {
+    return hist_percentile(&p->frame_times, pct);
+}
+
+void pacer_report(const FramePacer *p) {
+    const MsHistogram *h = &p->frame_times;
+    if (h->count == 0) return;
+    double avg = h->total_ms / (double)h->count;
+    printf("frames (%s): %llu, avg %.2f ms (%.1f fps), p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           pace_mode_names[p->mode], (unsigned long long)h->count, avg, avg > 0 ? 1000.0 / avg : 0.0,
+           pacer_percentile_ms(p, 50.0), pacer_percentile_ms(p, 99.0), h->max_ms);
+    if (p->late_latch) {
+        printf("late latch: lead %.2f ms before each present, %d presents past their deadline\n",
+               (double)p->lead * 1000.0 / (double)p->freq, p->missed);
+    }
+}
+
+/* Input latency probe: every press is timed from its event timestamp to the
+ * return of the first present whose snapshot includes the tick that applied
+ * it. */
+void latency_probe_present(MsHistogram *h, InputLatch *l, Uint32 shown_tick, Uint64 presented) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    const InputEvent *e;
+    while ((e = input_queue_peek(&l->applied)) && (Sint32)(shown_tick - e->tick) >= 0) {
+        hist_record(h, presented > e->time ? (double)(presented - e->time) * 1000.0 / (double)freq : 0.0);
+        input_queue_pop(&l->applied);
+    }
+}
+
+void latency_probe_report(const MsHistogram *h) {
+    if (h->count == 0) return;
+    printf("input latency: %llu presses, avg %.2f ms, p50 %.2f ms, p99 %.2f ms, max %.2f ms (key event to present)\n",
+           (unsigned long long)h->count, h->total_ms / (double)h->count, hist_percentile(h, 50.0),
+           hist_percentile(h, 99.0), h->max_ms);
+}
+
+/* SDL stamps events in SDL_GetTicks milliseconds; maps a stamp onto the
+ * performance counter the ticks are scheduled on, given both clocks read
+ * at the same moment. */
+static Uint64 input_event_time(Uint32 timestamp, Uint64 now, Uint32 now_ms) {
+    Uint64 age = now_ms > timestamp ? (Uint64)(now_ms - timestamp) * SDL_GetPerformanceFrequency() / 1000 : 0;
+    return now > age ? now - age : 0;
+}
+
+/* -------------------- Main -------------------- */
+
+typedef enum { BACKEND_AUTO, BACKEND_SDL, BACKEND_SOFT } RenderBackend;
+
+typedef struct {
+    int headless;
+    long ticks;
+    PaceMode pace;
+    int fps;
+    Limits limits;
+    int has_seed;
+    Uint64 seed;
+    const char *record;
+    const char *replay;
+    const char *trace;
+    RenderBackend backend;
+    int single_thread;
+    int batch;
+    int threads;
+    int obs_width, obs_height;
+    ObsFormat obs_format;
+    const char *obs_shm;
+    int audio_buffer;
+    int late_latch;
+    int rewind;             /* seconds of history; 0 = off */
+} Options;
+
+/* Seeds both generators, taking the seed from the replay when playing one. */
+static Uint64 seed_game(Game *g, const Options *opt, const Replay *replay) {
+    Uint64 seed = opt->has_seed ? opt->seed : SDL_GetPerformanceCounter();
+    if (replay && replay->fp) seed = replay->seed;
+    game_seed(g, seed);
+    return seed;
+}
+
+/* A replay brings the limits that affect play; the rest come from options. */
+static Limits run_limits(const Options *opt, const Replay *replay) {
+    Limits l = opt->limits;
+    if (replay && replay->fp) {
+        l.alien_rows = replay->alien_rows;
+        l.alien_cols = replay->alien_cols;
+        l.bullets = replay->bullets;
+        limits_clamp(&l);
+    }
+    return l;
+}
+
+#define HEADLESS_DEFAULT_TICKS 100000
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+/* Steps the simulation as fast as possible with no window, renderer or
+ * audio device, then reports throughput. */
+int run_headless(const Options *opt) {
+    long max_ticks = opt->ticks;
+    if (SDL_Init(SDL_INIT_TIMER) != 0) {
+        SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
+        return 1;
+    }
+    Replay play = {0}, rec = {0};
+    if (opt->replay && !replay_open_read(&play, opt->replay)) {
+        SDL_Quit();
+        return 1;
+    }
+    Limits limits = run_limits(opt, &play);
+    Arena arena;
+    Rewind rewind;
+    if (!arena_init(&arena, game_footprint(&limits) + rewind_footprint(&limits, opt->rewind)) ||
+        !game_init(&game, &arena, &limits) || !rewind_init(&rewind, &arena, &limits, opt->rewind)) {
+        replay_close(&play);
+        arena_free(&arena);
+        SDL_Quit();
+        return 1;
+    }
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+    prof_init();
+    if (opt->trace) prof_open_trace(opt->trace);
+
+    Uint64 seed = seed_game(&game, opt, &play);
+    if (opt->record) replay_open_write(&rec, opt->record, seed, &limits);
+    reset_game(&game);
+    /* No audio device, and ticks run back to back on a schedule of their own. */
+    game.audible = 0;
+
+    long ticks = 0;
+    long games = 1;
+    int best_score = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 tick_period = SDL_GetPerformanceFrequency() / SIM_HZ;
+    Uint64 due = start;
+    /* A replay runs to the end of its log regardless of --ticks. */
+    while (!stop_requested && (play.fp || max_ticks <= 0 || ticks < max_ticks)) {
+        Input in = {0};
+        if (!play.fp) autopilot_input(&game, &in);
+        int score = game.score, active = game.active;
+        due += tick_period;
+        if (!run_tick(&game, &in, &play, &rec, &rewind, due)) break;
+        if (in.restart && !active) {
+            if (score > best_score) best_score = score;
+            games++;
         }
+        prof_count(PROF_LIVE_PARTICLES, game.particles.count);
+        prof_frame_end();
+        ticks++;
+    }
+    double secs = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+    if (game.score > best_score) best_score = game.score;
+
+    printf("headless: %ld ticks in %.3f s (%.0f ticks/s), %ld games, best score %d, wave %d, seed %llu\n",
+           ticks, secs, secs > 0 ? ticks / secs : 0.0, games, best_score, game.wave, (unsigned long long)seed);
+    pool_report(&limits, &game.overflow, game.particles.dropped);
+    int status = 0;
+    if (rewind.frames) {
+        rewind_report(&rewind);
+        int ok = rewind_check(&rewind, &game);
+        printf("rewind: decoded and resimulated states %s\n", ok ? "match" : "MISMATCH");
+        if (!ok) status = 2;
     }
+    if (play.fp) {
+        /* Stopped before the log ran out. */
+        if (!replay_verify(&play, &game)) status = 2;
+        replay_close(&play);
+    } else if (opt->replay && !play.matched) {
+        status = 2;
+    }
+    replay_close_write(&rec, game_state_hash(&game));
+    /* Last, as it moves the game off the state reported above. */
+    if (!rewind_hold_check(&game, &rewind)) status = 2;
+    prof_close_trace();
+    arena_free(&arena);
+    SDL_Quit();
+    return status;
 }
 
-int count_active_player_bullets(void) {
-    int count = 0;
-    for (int i = 0; i < player_bullet_count; ++i) {
-        if (player_bullets[i].y + player_bullets[i].h >= 0) {
-            count++;
+#define BATCH_ROUND_STEPS 1000
+
+/* Plays opt->batch games at once under the autopilot across a worker pool
+ * and reports aggregate throughput; --ticks counts ticks per game. */
+int run_batch(const Options *opt) {
+    if (SDL_Init(SDL_INIT_TIMER) != 0) {
+        SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
+        return 1;
+    }
+    int threads = opt->threads > 0 ? opt->threads : SDL_GetCPUCount();
+    Uint64 seed = opt->has_seed ? opt->seed : SDL_GetPerformanceCounter();
+    Batch batch;
+    if (!batch_init(&batch, opt->batch, threads, &opt->limits, seed)) {
+        SDL_Log("Failed to set up %d batch games", opt->batch);
+        SDL_Quit();
+        return 1;
+    }
+    ObsSpec spec = {opt->obs_width, opt->obs_height, opt->obs_format};
+    ObsShm shm = {0};
+    Uint8 *frames = NULL;
+    if (spec.width > 0 && spec.height > 0) {
+        if (opt->obs_shm) {
+            if (obs_shm_open(&shm, opt->obs_shm, &spec, batch.count)) frames = shm.frames;
+        } else {
+            frames = malloc(obs_frame_stride(&spec) * (size_t)batch.count);
         }
+        if (!frames) {
+            SDL_Log("Failed to allocate observation frames");
+            batch_free(&batch);
+            SDL_Quit();
+            return 1;
+        }
+        batch_set_observations(&batch, &spec, frames, shm.header ? &shm.header->generation : NULL);
     }
-    return count;
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    long ticks = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    while (!stop_requested && (opt->ticks <= 0 || ticks < opt->ticks)) {
+        int steps = BATCH_ROUND_STEPS;
+        if (opt->ticks > 0 && opt->ticks - ticks < steps) steps = (int)(opt->ticks - ticks);
+        batch_run(&batch, steps);
+        ticks += steps;
+    }
+    double secs = (double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+
+    long episodes = 0;
+    int best_score = 0;
+    PoolOverflow overflow = {0};
+    int particles_dropped = 0;
+    for (int i = 0; i < batch.count; ++i) {
+        const Game *g = &batch.games[i];
+        episodes += batch.episodes[i];
+        if (batch.best_score[i] > best_score) best_score = batch.best_score[i];
+        if (g->score > best_score) best_score = g->score;
+        overflow.player_bullets += g->overflow.player_bullets;
+        overflow.alien_bullets += g->overflow.alien_bullets;
+        particles_dropped += g->particles.dropped;
+    }
+    double steps = (double)ticks * batch.count;
+    printf("batch: %d games x %ld ticks on %d threads in %.3f s (%.0f steps/s), "
+           "%ld episodes, best score %d, %d steals, seed %llu\n",
+           batch.count, ticks, batch.worker_count, secs, secs > 0 ? steps / secs : 0.0,
+           episodes, best_score, SDL_AtomicGet(&batch.steals), (unsigned long long)seed);
+    pool_report(&batch.limits, &overflow, particles_dropped);
+    if (frames) {
+        printf("observations: %dx%d %s, %zu bytes per game%s%s\n", spec.width, spec.height,
+               obs_format_names[spec.format], obs_frame_size(&spec), shm.header ? " in shared memory " : "",
+               shm.header ? opt->obs_shm : "");
+    }
+    batch_free(&batch);
+    if (shm.header) {
+        obs_shm_close(&shm);
+    } else {
+        free(frames);
+    }
+    SDL_Quit();
+    return 0;
 }
 
-void draw_hud(SDL_Renderer *renderer) {
-    SDL_SetRenderDrawColor(renderer, COLOR_HUD.r, COLOR_HUD.g, COLOR_HUD.b, COLOR_HUD.a);
-    int scale = 2;
-    int y = 10 + shake_y;
-    int x = 10 + shake_x;
-    draw_text_block(renderer, x, y, scale, "SCORE:");
-    x += text_width_block("SCORE:", scale) + 2;
-    draw_number(renderer, x, y, scale, score);
-
-    x = 250 + shake_x;
-    draw_text_block(renderer, x, y, scale, "LIVES:");
-    x += text_width_block("LIVES:", scale) + 2;
-    draw_number(renderer, x, y, scale, lives);
-
-    x = 450 + shake_x;
-    draw_text_block(renderer, x, y, scale, "WAVE:");
-    x += text_width_block("WAVE:", scale) + 2;
-    draw_number(renderer, x, y, scale, wave);
-}
-
-void reset_game(void) {
-    ship = (SDL_Rect){(WIDTH - SHIP_WIDTH) / 2, HEIGHT - SHIP_HEIGHT - 10, SHIP_WIDTH, SHIP_HEIGHT};
-    score = 0;
-    lives = 3;
-    wave = 1;
-    invuln_timer = 0;
-    active = 1;
-    init_wave(1);
-}
-
-int main(void) {
+int run_windowed(const Options *opt) {
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
         SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
         return 1;
@@ -596,224 +4517,374 @@ int main(void) {
         return 1;
     }
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    Uint32 renderer_flags = SDL_RENDERER_ACCELERATED;
+    if (opt->pace == PACE_VSYNC) renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, renderer_flags);
     if (!renderer) {
         SDL_Log("Failed to create renderer: %s", SDL_GetError());
         SDL_DestroyWindow(window);
         SDL_Quit();
         return 1;
     }
+    PaceMode pace = opt->pace;
+    SDL_RendererInfo info;
+    SDL_zero(info);
+    SDL_GetRendererInfo(renderer, &info);
+    if (pace == PACE_VSYNC && !(info.flags & SDL_RENDERER_PRESENTVSYNC)) {
+        SDL_Log("Renderer has no vsync; falling back to hybrid pacing");
+        pace = PACE_HYBRID;
+    }
+    /* SDL's own software renderer pays per call, so draw into our framebuffer. */
+    int software = (info.flags & SDL_RENDERER_SOFTWARE) || (info.name && strcmp(info.name, "software") == 0);
+    if (opt->backend == BACKEND_SOFT || (opt->backend == BACKEND_AUTO && software)) {
+        if (softfb_init(renderer, WIDTH, HEIGHT)) {
+            SDL_Log("Using the software framebuffer backend");
+        }
+    }
     SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    build_sprite_atlas(renderer);
+    build_glyph_atlas(renderer);
+    layers_init(renderer);
+
+    Replay play = {0}, rec = {0};
+    if (opt->replay && !replay_open_read(&play, opt->replay)) {
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    Limits limits = run_limits(opt, &play);
+    Arena arena;
+    Rewind rewind;
+    if (!arena_init(&arena, game_footprint(&limits) + snapshot_buffer_footprint(&limits) +
+                                particle_geometry_footprint(limits.particles) + audio_pools_footprint(&limits) +
+                                rewind_footprint(&limits, opt->rewind)) ||
+        !game_init(&game, &arena, &limits) || !snapshot_buffer_init(&snapshots, &arena, &limits) ||
+        !particle_geometry_init(&arena, limits.particles) || !audio_pools_init(&arena, &limits) ||
+        !rewind_init(&rewind, &arena, &limits, opt->rewind)) {
+        replay_close(&play);
+        arena_free(&arena);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
 
     SDL_AudioSpec want, have;
     SDL_zero(want);
     want.freq = 44100;
     want.format = AUDIO_S16SYS;
     want.channels = 1;
-    want.samples = 2048;
+    want.samples = (Uint16)audio_buffer_frames(opt->audio_buffer);
     want.callback = audio_callback;
+    init_wavetables();
 
     audio.device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
     if (audio.device == 0) {
         SDL_Log("Failed to open audio: %s", SDL_GetError());
     } else {
         audio.freq = have.freq;
+        audio.buffer = have.samples;
+        build_sound_bank();
+        SDL_PauseAudioDevice(audio.device, 0);
+    }
+
+    Uint64 seed = seed_game(&game, opt, &play);
+    if (opt->record) replay_open_write(&rec, opt->record, seed, &limits);
+    reset_game(&game);
+    game.audible = 1;
+    prof_init();
+    if (opt->trace) prof_open_trace(opt->trace);
+
+    snapshot_capture(&snapshots.slots[snapshots.read], &game, SDL_GetPerformanceCounter());
+
+    /* Under vsync the late-latch deadline is the display's refresh. */
+    int fps = opt->fps;
+    SDL_DisplayMode mode;
+    if (pace == PACE_VSYNC && SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) {
+        fps = mode.refresh_rate;
     }
+    FramePacer pacer;
+    pacer_init(&pacer, pace, fps, opt->late_latch);
+    Uint64 tick_period = pacer.freq / SIM_HZ;
+    Uint64 max_accumulator = pacer.freq * MAX_FRAME_MS / 1000;
+    Uint64 accumulator = 0;
+    MsHistogram input_latency;
+    SDL_zero(input_latency);
 
-    srand((unsigned int)SDL_GetTicks());
-    reset_game();
+    InputLatch input;
+    SDL_zero(input);
+    SimThread sim = {.input = &input, .snapshots = &snapshots, .play = &play, .rec = &rec, .rewind = &rewind,
+                     .tick_period = tick_period, .max_lag = max_accumulator};
+    SDL_Thread *sim_thread = NULL;
+    if (!opt->single_thread && SDL_GetCPUCount() > 1) {
+        SDL_AtomicSet(&sim.running, 1);
+        sim_thread = SDL_CreateThread(sim_thread_main, "simulation", &sim);
+        if (!sim_thread) SDL_Log("Failed to start simulation thread: %s", SDL_GetError());
+    }
 
     int running = 1;
-    Uint32 last = SDL_GetTicks();
     while (running) {
-        Uint32 now = SDL_GetTicks();
-        int dt = (int)(now - last);
-        last = now;
+        /* Wait first, so input is polled as close to the present as the
+         * pacer allows. */
+        Uint64 elapsed = pacer_wait(&pacer);
 
+        Uint64 t = prof_begin();
+        Uint64 poll_time = SDL_GetPerformanceCounter();
+        Uint32 poll_ms = SDL_GetTicks();
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
                 running = 0;
-            } else if (event.type == SDL_KEYDOWN) {
+            } else if (event.type == SDL_RENDER_TARGETS_RESET) {
+                invalidate_hud();
+                invalidate_layers();
+            } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+                int down = event.type == SDL_KEYDOWN;
+                Uint64 when = input_event_time(event.key.timestamp, poll_time, poll_ms);
                 SDL_Keycode key = event.key.keysym.sym;
-                if (key == SDLK_ESCAPE) {
+                if (key == SDLK_LEFT || key == SDLK_RIGHT) {
+                    if (!event.key.repeat) input_latch_push(&input, key == SDLK_LEFT ? INPUT_LEFT : INPUT_RIGHT, down, when);
+                } else if (key == SDLK_BACKSPACE) {
+                    if (!event.key.repeat) input_latch_push(&input, INPUT_REWIND, down, when);
+                } else if (!down) {
+                    continue;
+                } else if (key == SDLK_ESCAPE) {
                     running = 0;
-                } else if (key == SDLK_SPACE && active) {
-                    if (count_active_player_bullets() < 3 && player_bullet_count < MAX_BULLETS) {
-                        player_bullets[player_bullet_count++] =
-                            (SDL_Rect){ship.x + SHIP_WIDTH / 2 - BULLET_WIDTH / 2,
-                                       ship.y - BULLET_HEIGHT, BULLET_WIDTH, BULLET_HEIGHT};
-                        muzzle_timer = 50;
-                        enqueue_sound(SND_PLAYER_SHOT);
-                    }
-                } else if (key == SDLK_r && !active) {
-                    reset_game();
+                } else if (key == SDLK_SPACE) {
+                    input_latch_push(&input, INPUT_FIRE, 1, when);
+                } else if (key == SDLK_r) {
+                    input_latch_push(&input, INPUT_RESTART, 1, when);
+                } else if (key == SDLK_F3) {
+                    prof_set_overlay(!profiler.overlay);
                 }
             }
         }
+        prof_end(PROF_EVENTS, t);
 
-        update_sounds(dt);
-
-        const Uint8 *state = SDL_GetKeyboardState(NULL);
-        if (active) {
-            if (state[SDL_SCANCODE_LEFT]) {
-                ship.x -= SHIP_SPEED;
-                if (ship.x < 0) ship.x = 0;
-            }
-            if (state[SDL_SCANCODE_RIGHT]) {
-                ship.x += SHIP_SPEED;
-                if (ship.x > WIDTH - SHIP_WIDTH) ship.x = WIDTH - SHIP_WIDTH;
-            }
-
-            int alive_count = 0;
-            for (int i = 0; i < ALIEN_COUNT; ++i) {
-                if (alien_alive[i]) alive_count++;
-            }
-            float speed_multiplier = 1.0f + (ALIEN_COUNT - alive_count) * 0.02f;
-            float move = alien_base_speed * speed_multiplier;
-
-            int edge_hit = 0;
-            for (int i = 0; i < ALIEN_COUNT; ++i) {
-                if (!alien_alive[i]) continue;
-                alien_fx[i] += alien_direction * move;
-                aliens[i].x = (int)alien_fx[i];
-                if (aliens[i].x < 0 || aliens[i].x + aliens[i].w > WIDTH) {
-                    edge_hit = 1;
-                }
-            }
-            if (edge_hit) {
-                for (int i = 0; i < ALIEN_COUNT; ++i) {
-                    if (!alien_alive[i]) continue;
-                    alien_fx[i] -= alien_direction * move;
-                    aliens[i].x = (int)alien_fx[i];
-                    aliens[i].y += ALIEN_STEP_DOWN;
-                }
-                alien_direction *= -1;
-            }
-
-            alien_fire_timer -= dt;
-            if (alien_fire_timer <= 0) {
-                int cols[ALIEN_COLS];
-                int colcount = 0;
-                for (int c = 0; c < ALIEN_COLS; ++c) {
-                    for (int r = ALIEN_ROWS - 1; r >= 0; --r) {
-                        int idx = r * ALIEN_COLS + c;
-                        if (alien_alive[idx]) { cols[colcount++] = c; break; }
-                    }
-                }
-                if (colcount > 0) {
-                    int col = cols[rand() % colcount];
-                    for (int r = ALIEN_ROWS - 1; r >= 0; --r) {
-                        int idx = r * ALIEN_COLS + col;
-                        if (alien_alive[idx]) { spawn_alien_bullet(aliens[idx]); break; }
-                    }
-                }
-                alien_fire_timer = alien_fire_interval;
-            }
-
-            check_collisions();
-
-            if (invuln_timer > 0) invuln_timer -= dt;
-
-            if (alive_count == 0 && wave_clear_timer < 0) {
-                wave_clear_timer = 1500;
-                enqueue_sound(SND_WAVE_CLEAR);
+        if (!sim_thread) {
+            /* Run as many fixed ticks as the elapsed time covers. */
+            accumulator += elapsed;
+            if (accumulator > max_accumulator) accumulator = max_accumulator;
+            Uint64 now = SDL_GetPerformanceCounter();
+            int ticked = 0;
+            while (accumulator >= tick_period) {
+                Input tick_in;
+                Uint64 due = now - accumulator + tick_period;
+                input_latch_take(&input, &tick_in, accumulator < 2 * tick_period ? now : due, game.tick + 1);
+                run_tick(&game, &tick_in, &play, &rec, &rewind, due);
+                accumulator -= tick_period;
+                ticked = 1;
             }
-            if (wave_clear_timer >= 0) {
-                wave_clear_timer -= dt;
-                if (wave_clear_timer <= 0) {
-                    wave++;
-                    init_wave(wave);
-                }
+            if (ticked) {
+                snapshot_capture(snapshot_back(&snapshots), &game, now - accumulator);
+                snapshot_publish(&snapshots);
             }
         }
 
-        update_particles(dt);
-        if (muzzle_timer > 0) muzzle_timer -= dt;
-        if (shake_timer > 0) shake_timer -= dt;
-        for (int i = 0; i < ALIEN_COUNT; ++i) {
-            if (alien_flash[i] > 0) alien_flash[i] -= dt;
-        }
-        if (shake_timer > 0) {
-            shake_x = (rand() % (SHAKE_MAG * 2 + 1)) - SHAKE_MAG;
-            shake_y = (rand() % (SHAKE_MAG * 2 + 1)) - SHAKE_MAG;
-        } else {
-            shake_x = shake_y = 0;
-        }
+        const Snapshot *snap = snapshot_acquire(&snapshots);
+        Uint64 now = SDL_GetPerformanceCounter();
+        double alpha = now > snap->tick_time ? (double)(now - snap->tick_time) / (double)tick_period : 0.0;
+        if (alpha > 1.0) alpha = 1.0;
+        prof_count(PROF_VOICES, SDL_AtomicGet(&audio.voices));
+        prof_count(PROF_LIVE_PARTICLES, snap->particles.count);
+        render_frame(renderer, snap, (float)alpha);
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
+        Uint64 submit = SDL_GetPerformanceCounter();
+        t = prof_begin();
+        render_present(renderer);
+        prof_end(PROF_PRESENT, t);
+        Uint64 presented = SDL_GetPerformanceCounter();
+        pacer_frame_done(&pacer, submit, presented);
+        latency_probe_present(&input_latency, &input, snap->tick, presented);
+        prof_frame_end();
+    }
+    if (sim_thread) {
+        SDL_AtomicSet(&sim.running, 0);
+        SDL_WaitThread(sim_thread, NULL);
+    }
+    pacer_report(&pacer);
+    latency_probe_report(&input_latency);
+    audio_report();
+    pool_report(&limits, &game.overflow, game.particles.dropped);
+    rewind_report(&rewind);
+    replay_close(&play);
+    replay_close_write(&rec, game_state_hash(&game));
+    prof_close_trace();
 
-        int alien_frame = (SDL_GetTicks() / 500) % 2;
-        int alien_scale = ALIEN_WIDTH / ALIEN_BMP_W;
-        for (int i = 0; i < ALIEN_COUNT; ++i) {
-            if (alien_alive[i] || alien_flash[i] > 0) {
-                if (alien_flash[i] > 0) {
-                    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-                } else {
-                    SDL_SetRenderDrawColor(renderer, COLOR_ALIEN.r, COLOR_ALIEN.g, COLOR_ALIEN.b, 255);
-                }
-                int type = i / ALIEN_COLS;
-                draw_bitmap(renderer, aliens[i].x + shake_x, aliens[i].y + shake_y, alien_scale,
-                            alien_bitmaps[type][alien_frame], ALIEN_BMP_W, ALIEN_BMP_H);
-            }
-        }
+    if (audio.device) SDL_CloseAudioDevice(audio.device);
+    destroy_sound_bank();
+    destroy_hud();
+    layers_free();
+    destroy_glyph_atlas();
+    destroy_sprite_atlas();
+    softfb_free();
+    particle_geometry_free();
+    arena_free(&arena);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
 
-        if (invuln_timer <= 0 || (SDL_GetTicks() / 100) % 2 == 0) {
-            SDL_SetRenderDrawColor(renderer, COLOR_PLAYER.r, COLOR_PLAYER.g, COLOR_PLAYER.b, 255);
-            int ship_scale = SHIP_WIDTH / SHIP_BMP_W;
-            draw_bitmap(renderer, ship.x + shake_x, ship.y + shake_y, ship_scale, ship_bitmap,
-                        SHIP_BMP_W, SHIP_BMP_H);
-        }
+/* bench.c includes this file for its kernels and supplies its own main(). */
+#ifndef VADERS_NO_MAIN
+static void print_usage(const char *prog) {
+    printf("usage: %s [--headless] [--ticks N] [--pace vsync|hybrid|uncapped] [--fps N]\n"
+           "          [--particles N] [--seed N] [--record FILE] [--replay FILE] [--trace FILE]\n"
+           "          [--renderer auto|sdl|soft] [--single-thread] [--batch N] [--threads N]\n"
+           "          [--obs WxH] [--obs-format planes|palette|gray] [--obs-shm NAME]\n"
+           "          [--formation RxC] [--bullets N] [--voices N] [--pending-sounds N] [--config FILE]\n"
+           "          [--audio-buffer N] [--no-late-latch] [--rewind SECONDS]\n"
+           "  --headless  run the simulation without video or audio as fast as possible\n"
+           "  --ticks N   number of simulation ticks to run headless (0 = until interrupted)\n"
+           "  --pace M    frame pacing: vsync (default), hybrid sleep+spin, or uncapped\n"
+           "  --fps N     target frame rate for hybrid pacing (default %d)\n"
+           "  --particles N  particle pool size (default %d)\n"
+           "  --seed N    seed for the game RNG (default: random)\n"
+           "  --record F  write every tick's input to a replay log\n"
+           "  --replay F  play a replay log back; with --headless, at full speed\n"
+           "  --trace F   write per-frame phase timings as Chrome trace JSON (F3 shows them live)\n"
+           "  --renderer B  draw through SDL, our software framebuffer, or pick by renderer (auto)\n"
+           "  --single-thread  run the simulation on the render thread instead of its own\n"
+           "  --batch N   play N autopilot games in parallel, --ticks each, and report steps/s\n"
+           "  --threads N worker threads for --batch (default: one per CPU)\n"
+           "  --obs WxH   with --batch, rasterize each game into a WxH observation frame\n"
+           "  --obs-format F  one plane per object class (planes, default), or a single\n"
+           "              plane of class indices (palette) or gray levels (gray)\n"
+           "  --obs-shm NAME  put the frames in POSIX shared memory NAME (e.g. /vaders-obs)\n"
+           "  --formation RxC  alien rows and columns (default %dx%d, at most %dx%d)\n"
+           "  --bullets N bullets in flight per side (default %d)\n"
+           "  --voices N  sound voices playing at once (default %d)\n"
+           "  --pending-sounds N  delayed beeps waiting to start (default %d)\n"
+           "  --config F  read limits from F as key = value lines: alien_rows, alien_cols,\n"
+           "              bullets, particles, voices, pending_sounds; later flags override\n"
+           "  --audio-buffer N  audio buffer in sample frames, rounded to a power of two\n"
+           "              (default %d; 128-512 for low latency)\n"
+           "  --no-late-latch  wait right after each present instead of just before the\n"
+           "              next one; input is then polled up to a frame earlier\n"
+           "  --rewind N  keep N seconds of history (at most %d, default off); hold Backspace\n"
+           "              to step back through it; with --headless, checked against\n"
+           "              resimulation at exit\n",
+           prog, PACE_DEFAULT_FPS, PARTICLE_MAX, ALIEN_ROWS_DEFAULT, ALIEN_COLS_DEFAULT, ALIEN_MAX_ROWS,
+           ALIEN_MAX_COLS, BULLETS_DEFAULT, VOICES_DEFAULT, PENDING_SOUNDS_DEFAULT, AUDIO_BUFFER_DEFAULT,
+           REWIND_MAX_SECONDS);
+}
 
-        if (muzzle_timer > 0) {
-            SDL_SetRenderDrawColor(renderer, COLOR_PLAYER_BULLET.r, COLOR_PLAYER_BULLET.g, COLOR_PLAYER_BULLET.b, 255);
-            int cx = ship.x + SHIP_WIDTH / 2 + shake_x;
-            int cy = ship.y + shake_y;
-            SDL_Rect r1 = {cx - 1, cy - 8, 2, 8};
-            SDL_Rect r2 = {cx - 4, cy - 4, 8, 2};
-            SDL_RenderFillRect(renderer, &r1);
-            SDL_RenderFillRect(renderer, &r2);
-        }
+static const char *backend_names[] = {"auto", "sdl", "soft"};
 
-        SDL_SetRenderDrawColor(renderer, COLOR_PLAYER_BULLET.r, COLOR_PLAYER_BULLET.g, COLOR_PLAYER_BULLET.b, 255);
-        for (int i = 0; i < player_bullet_count; ++i) {
-            SDL_Rect r = player_bullets[i];
-            r.x += shake_x;
-            r.y += shake_y;
-            SDL_RenderFillRect(renderer, &r);
+static int parse_backend(const char *name, RenderBackend *out) {
+    for (int i = 0; i < (int)(sizeof(backend_names) / sizeof(backend_names[0])); ++i) {
+        if (strcmp(name, backend_names[i]) == 0) {
+            *out = (RenderBackend)i;
+            return 1;
         }
-        SDL_SetRenderDrawColor(renderer, COLOR_ALIEN_BULLET.r, COLOR_ALIEN_BULLET.g, COLOR_ALIEN_BULLET.b, 255);
-        for (int i = 0; i < alien_bullet_count; ++i) {
-            SDL_Rect r = alien_bullets[i];
-            r.x += shake_x;
-            r.y += shake_y;
-            SDL_RenderFillRect(renderer, &r);
+    }
+    return 0;
+}
+
+static int parse_obs_format(const char *name, ObsFormat *out) {
+    for (int i = 0; i < (int)(sizeof(obs_format_names) / sizeof(obs_format_names[0])); ++i) {
+        if (strcmp(name, obs_format_names[i]) == 0) {
+            *out = (ObsFormat)i;
+            return 1;
         }
+    }
+    return 0;
+}
 
-        draw_particles(renderer);
+/* As parse_long, for unsigned 64-bit values such as seeds. */
+static int parse_u64(const char *text, Uint64 *out) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || text[0] == '-') return 0;
+    *out = (Uint64)v;
+    return 1;
+}
 
-        draw_hud(renderer);
+/* "WxH" with nothing after it. */
+static int parse_size(const char *text, int *w, int *h) {
+    char tail;
+    return sscanf(text, "%dx%d%c", w, h, &tail) == 2;
+}
 
-        if (!active) {
-            const char *msg = "GAME OVER - Press R to restart";
-            int w = text_width_block(msg, 2);
-            int x = (WIDTH - w) / 2 + shake_x;
-            int y = HEIGHT / 2 - (7 * 2) / 2 + shake_y;
-            SDL_SetRenderDrawColor(renderer, COLOR_HUD.r, COLOR_HUD.g, COLOR_HUD.b, 255);
-            draw_text_block(renderer, x, y, 2, msg);
+static int parse_pace_mode(const char *name, PaceMode *out) {
+    for (int i = 0; i < (int)(sizeof(pace_mode_names) / sizeof(pace_mode_names[0])); ++i) {
+        if (strcmp(name, pace_mode_names[i]) == 0) {
+            *out = (PaceMode)i;
+            return 1;
         }
-
-        SDL_RenderPresent(renderer);
-
-        Uint32 frame_time = SDL_GetTicks() - now;
-        if (frame_time < 16) SDL_Delay(16 - frame_time);
     }
-
-    if (audio.device) SDL_CloseAudioDevice(audio.device);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
     return 0;
 }
 
+int main(int argc, char **argv) {
+    Options opt = {0, HEADLESS_DEFAULT_TICKS, PACE_VSYNC, PACE_DEFAULT_FPS, LIMITS_DEFAULT, 0, 0, NULL, NULL, NULL, BACKEND_AUTO, 0, 0, 0, 0, 0, OBS_PLANES, NULL, AUDIO_BUFFER_DEFAULT, 1, 0};
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        int has_value = i + 1 < argc;
+        if (strcmp(arg, "--headless") == 0) {
+            opt.headless = 1;
+        } else if (strcmp(arg, "--ticks") == 0 && has_value && parse_long(argv[i + 1], &opt.ticks)) {
+            ++i;
+        } else if (strcmp(arg, "--pace") == 0 && has_value && parse_pace_mode(argv[i + 1], &opt.pace)) {
+            ++i;
+        } else if (strcmp(arg, "--fps") == 0 && has_value && parse_int(argv[i + 1], &opt.fps)) {
+            ++i;
+        } else if (strcmp(arg, "--particles") == 0 && has_value && parse_int(argv[i + 1], &opt.limits.particles)) {
+            ++i;
+        } else if (strcmp(arg, "--formation") == 0 && has_value &&
+                   parse_size(argv[i + 1], &opt.limits.alien_rows, &opt.limits.alien_cols)) {
+            ++i;
+        } else if (strcmp(arg, "--bullets") == 0 && has_value && parse_int(argv[i + 1], &opt.limits.bullets)) {
+            ++i;
+        } else if (strcmp(arg, "--voices") == 0 && has_value && parse_int(argv[i + 1], &opt.limits.voices)) {
+            ++i;
+        } else if (strcmp(arg, "--pending-sounds") == 0 && has_value && parse_int(argv[i + 1], &opt.limits.pending_sounds)) {
+            ++i;
+        } else if (strcmp(arg, "--config") == 0 && has_value) {
+            if (!limits_load(&opt.limits, argv[++i])) return 1;
+        } else if (strcmp(arg, "--seed") == 0 && has_value && parse_u64(argv[i + 1], &opt.seed)) {
+            opt.has_seed = 1;
+            ++i;
+        } else if (strcmp(arg, "--record") == 0 && has_value) {
+            opt.record = argv[++i];
+        } else if (strcmp(arg, "--replay") == 0 && has_value) {
+            opt.replay = argv[++i];
+        } else if (strcmp(arg, "--trace") == 0 && has_value) {
+            opt.trace = argv[++i];
+        } else if (strcmp(arg, "--batch") == 0 && has_value && parse_int(argv[i + 1], &opt.batch)) {
+            ++i;
+        } else if (strcmp(arg, "--threads") == 0 && has_value && parse_int(argv[i + 1], &opt.threads)) {
+            ++i;
+        } else if (strcmp(arg, "--obs") == 0 && has_value &&
+                   parse_size(argv[i + 1], &opt.obs_width, &opt.obs_height)) {
+            ++i;
+        } else if (strcmp(arg, "--obs-format") == 0 && has_value && parse_obs_format(argv[i + 1], &opt.obs_format)) {
+            ++i;
+        } else if (strcmp(arg, "--obs-shm") == 0 && has_value) {
+            opt.obs_shm = argv[++i];
+        } else if (strcmp(arg, "--audio-buffer") == 0 && has_value && parse_int(argv[i + 1], &opt.audio_buffer)) {
+            ++i;
+        } else if (strcmp(arg, "--rewind") == 0 && has_value && parse_int(argv[i + 1], &opt.rewind)) {
+            ++i;
+            if (opt.rewind < 0) opt.rewind = 0;
+            if (opt.rewind > REWIND_MAX_SECONDS) opt.rewind = REWIND_MAX_SECONDS;
+        } else if (strcmp(arg, "--no-late-latch") == 0) {
+            opt.late_latch = 0;
+        } else if (strcmp(arg, "--single-thread") == 0) {
+            opt.single_thread = 1;
+        } else if (strcmp(arg, "--renderer") == 0 && has_value && parse_backend(argv[i + 1], &opt.backend)) {
+            ++i;
+        } else {
+            print_usage(argv[0]);
+            return strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+    }
+    limits_clamp(&opt.limits);
+    if (opt.batch > 0) return run_batch(&opt);
+    return opt.headless ? run_headless(&opt) : run_windowed(&opt);
+}
+#endif